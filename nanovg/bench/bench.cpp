@@ -0,0 +1,622 @@
+/*
+** Host micro-benchmarks for the CPU side of nanovg-deko3d: path flattening and expansion,
+** text layout and the glyph cache, and the framework memory pool. The front end runs against
+** the null renderer so no GPU is involved; see the Makefile next to this file for how to build.
+*/
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "nanovg_null.h"
+#include "CMemPool.h"
+#include "bench_internal.h"
+
+/* Allocation counting. The Makefile links with --wrap for the C allocator entry points, so every
+   malloc, calloc and realloc made by nanovg, fontstash and the framework lands here; operator new
+   is routed through malloc below so C++ containers are counted as well. */
+extern "C" {
+    void *__real_malloc(size_t size);
+    void *__real_calloc(size_t count, size_t size);
+    void *__real_realloc(void *ptr, size_t size);
+    void *__real_aligned_alloc(size_t alignment, size_t size);
+
+    static bool g_counting = false;
+    static uint64_t g_allocs = 0;
+
+    void *__wrap_malloc(size_t size) {
+        g_allocs += g_counting;
+        return __real_malloc(size);
+    }
+
+    void *__wrap_calloc(size_t count, size_t size) {
+        g_allocs += g_counting;
+        return __real_calloc(count, size);
+    }
+
+    void *__wrap_realloc(void *ptr, size_t size) {
+        g_allocs += g_counting;
+        return __real_realloc(ptr, size);
+    }
+
+    void *__wrap_aligned_alloc(size_t alignment, size_t size) {
+        g_allocs += g_counting;
+        return __real_aligned_alloc(alignment, size);
+    }
+}
+
+void *operator new(size_t size) {
+    if (void *ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    /* Passed to each benchmark body, which runs its operation `iterations` times. Setup work that
+       should not be measured goes between Pause and Resume. */
+    class State {
+        private:
+            Clock::time_point m_start;
+            Clock::duration m_elapsed{};
+            uint64_t m_allocs = 0;
+        public:
+            const uint64_t iterations;
+
+            explicit State(uint64_t iterations) : iterations(iterations) { /* ... */ }
+
+            void Resume() {
+                g_allocs = 0;
+                g_counting = true;
+                m_start = Clock::now();
+            }
+
+            void Pause() {
+                m_elapsed += Clock::now() - m_start;
+                g_counting = false;
+                m_allocs += g_allocs;
+            }
+
+            double GetSeconds() const {
+                return std::chrono::duration<double>(m_elapsed).count();
+            }
+
+            uint64_t GetAllocs() const {
+                return m_allocs;
+            }
+    };
+
+    struct Benchmark {
+        std::string name;
+        std::function<void(State &)> body;
+    };
+
+    struct Options {
+        const char *filter = nullptr;
+        const char *font_path = "../../romfs/fonts/Roboto-Regular.ttf";
+        double min_time = 0.1;
+        int repetitions = 5;
+    };
+
+    struct Result {
+        double ns_per_op;
+        double allocs_per_op;
+        double spread;
+        uint64_t iterations;
+    };
+
+    Result RunOnce(const Benchmark &benchmark, uint64_t iterations, uint64_t *allocs) {
+        State state(iterations);
+        state.Resume();
+        benchmark.body(state);
+        state.Pause();
+
+        *allocs = state.GetAllocs();
+        return Result{state.GetSeconds() * 1e9 / static_cast<double>(iterations), 0.0, 0.0, iterations};
+    }
+
+    /* Grows the iteration count until one run takes at least min_time, then reports the median of
+       several runs of that length along with their spread, so noisy results are visible as such. */
+    Result Run(const Benchmark &benchmark, const Options &options) {
+        uint64_t allocs = 0;
+        uint64_t iterations = 1;
+
+        /* The first run doubles as warm-up, filling caches and growing buffers to their steady size. */
+        RunOnce(benchmark, iterations, &allocs);
+        for (;;) {
+            const Result result = RunOnce(benchmark, iterations, &allocs);
+            const double seconds = result.ns_per_op * static_cast<double>(iterations) * 1e-9;
+            if (seconds >= options.min_time) {
+                break;
+            }
+
+            const double scale = seconds > 0.0 ? options.min_time / seconds * 1.4 : 100.0;
+            iterations = static_cast<uint64_t>(static_cast<double>(iterations) * std::clamp(scale, 2.0, 100.0));
+        }
+
+        std::vector<double> samples;
+        uint64_t total_allocs = 0;
+        for (int i = 0; i < options.repetitions; i++) {
+            samples.push_back(RunOnce(benchmark, iterations, &allocs).ns_per_op);
+            total_allocs += allocs;
+        }
+        std::sort(samples.begin(), samples.end());
+
+        const double median = samples[samples.size() / 2];
+        return Result{
+            median,
+            static_cast<double>(total_allocs) / static_cast<double>(iterations * samples.size()),
+            median > 0.0 ? (samples.back() - samples.front()) / median : 0.0,
+            iterations,
+        };
+    }
+
+    /* Minimal LCG so the memory pool workloads are identical from run to run. */
+    class Random {
+        private:
+            uint32_t m_state;
+        public:
+            explicit Random(uint32_t seed) : m_state(seed) { /* ... */ }
+
+            uint32_t Next() {
+                m_state = m_state * 1664525u + 1013904223u;
+                return m_state >> 8;
+            }
+    };
+
+    constexpr const char *Paragraph =
+        "NanoVG is small antialiased vector graphics rendering library. This is a port to deko3d, "
+        "a low level 3D graphics API targetting the Nvidia Tegra X1 found inside the Nintendo Switch. "
+        "The quick brown fox jumps over the lazy dog 0123456789 times, while the glyph cache keeps up.";
+
+    void AddUiShapes(NVGcontext *vg) {
+        for (int i = 0; i < 8; i++) {
+            const float x = 10.0f + static_cast<float>(i) * 60.0f;
+            nvgRect(vg, x, 10.0f, 50.0f, 30.0f);
+            nvgRoundedRect(vg, x, 50.0f, 50.0f, 30.0f, 6.0f);
+            nvgCircle(vg, x + 25.0f, 110.0f, 18.0f);
+        }
+    }
+
+    void AddCurves(NVGcontext *vg) {
+        nvgMoveTo(vg, 20.0f, 300.0f);
+        for (int i = 0; i < 16; i++) {
+            const float x = 20.0f + static_cast<float>(i) * 40.0f;
+            nvgBezierTo(vg, x + 10.0f, 200.0f, x + 30.0f, 400.0f, x + 40.0f, 300.0f);
+        }
+        nvgEllipse(vg, 400.0f, 500.0f, 300.0f, 120.0f);
+        nvgArc(vg, 200.0f, 500.0f, 90.0f, 0.0f, NVG_PI * 1.5f, NVG_CW);
+    }
+
+    void AddStar(NVGcontext *vg) {
+        for (int i = 0; i < 10; i++) {
+            const float angle = static_cast<float>(i) * NVG_PI / 5.0f;
+            const float radius = (i & 1) ? 60.0f : 150.0f;
+            const float x = 300.0f + std::cos(angle) * radius;
+            const float y = 300.0f + std::sin(angle) * radius;
+            if (i == 0) {
+                nvgMoveTo(vg, x, y);
+            } else {
+                nvgLineTo(vg, x, y);
+            }
+        }
+        nvgClosePath(vg);
+    }
+
+    /* Open polyline with sharp and shallow corners plus a curve, so every join and both ends are hit. */
+    void AddStrokePath(NVGcontext *vg) {
+        nvgMoveTo(vg, 20.0f, 20.0f);
+        for (int i = 0; i < 24; i++) {
+            const float x = 40.0f + static_cast<float>(i) * 25.0f;
+            nvgLineTo(vg, x, (i & 1) ? 20.0f : 60.0f + static_cast<float>(i % 5) * 10.0f);
+        }
+        nvgBezierTo(vg, 700.0f, 200.0f, 500.0f, 300.0f, 300.0f, 200.0f);
+    }
+
+    void AddPathBenchmarks(std::vector<Benchmark> &benchmarks, NVGcontext *vg) {
+        const auto with_path = [vg](void (*build)(NVGcontext *)) {
+            nvgBeginPath(vg);
+            build(vg);
+        };
+
+        benchmarks.push_back({"nvg__flattenPaths/ui", [vg, with_path](State &state) {
+            state.Pause();
+            with_path(AddUiShapes);
+            state.Resume();
+            for (uint64_t i = 0; i < state.iterations; i++) {
+                benchFlattenPaths(vg);
+            }
+        }});
+
+        benchmarks.push_back({"nvg__flattenPaths/curves", [vg, with_path](State &state) {
+            state.Pause();
+            with_path(AddCurves);
+            state.Resume();
+            for (uint64_t i = 0; i < state.iterations; i++) {
+                benchFlattenPaths(vg);
+            }
+        }});
+
+        benchmarks.push_back({"nvg__tesselateBezier", [vg](State &state) {
+            for (uint64_t i = 0; i < state.iterations; i++) {
+                benchTesselateBezier(vg, 10.0f, 10.0f, 900.0f, 20.0f, -300.0f, 600.0f, 700.0f, 700.0f);
+            }
+        }});
+
+        const struct {
+            const char *name;
+            void (*build)(NVGcontext *);
+        } fills[] = {
+            { "nvg__expandFill/ui",     AddUiShapes },
+            { "nvg__expandFill/curves", AddCurves   },
+            { "nvg__expandFill/star",   AddStar     },
+        };
+
+        for (const auto &fill : fills) {
+            benchmarks.push_back({fill.name, [vg, with_path, build = fill.build](State &state) {
+                state.Pause();
+                with_path(build);
+                benchFlattenPaths(vg);
+                state.Resume();
+                for (uint64_t i = 0; i < state.iterations; i++) {
+                    benchExpandFill(vg);
+                }
+            }});
+        }
+
+        /* Whole fills of the most common UI shape, which the back-end can take without flattening it. */
+        benchmarks.push_back({"nvgFill/rounded-rect", [vg](State &state) {
+            constexpr uint64_t CallsPerFrame = 256;
+
+            state.Pause();
+            nvgBeginFrame(vg, 1280.0f, 720.0f, 1.0f);
+            nvgFillColor(vg, nvgRGBA(40, 120, 220, 255));
+            state.Resume();
+
+            for (uint64_t i = 0; i < state.iterations; i++) {
+                nvgBeginPath(vg);
+                nvgRoundedRect(vg, 10.0f, 10.0f + static_cast<float>(i % 32) * 20.0f, 200.0f, 18.0f, 6.0f);
+                nvgFill(vg);
+
+                /* Keep the recorded frame bounded without timing the restart. */
+                if ((i + 1) % CallsPerFrame == 0) {
+                    state.Pause();
+                    nvgCancelFrame(vg);
+                    nvgBeginFrame(vg, 1280.0f, 720.0f, 1.0f);
+                    state.Resume();
+                }
+            }
+
+            state.Pause();
+            nvgCancelFrame(vg);
+            state.Resume();
+        }});
+
+        /* The same list rows as above, recorded as one fill of 32 instances instead of 32 fills. */
+        benchmarks.push_back({"nvgFillInstances/rounded-rect-x32", [vg](State &state) {
+            constexpr uint64_t CallsPerFrame = 8;
+            constexpr int InstanceCount = 32;
+
+            float xforms[InstanceCount * 6];
+            NVGcolor colors[InstanceCount];
+            for (int i = 0; i < InstanceCount; i++) {
+                nvgTransformTranslate(&xforms[i * 6], 0.0f, static_cast<float>(i) * 20.0f);
+                colors[i] = nvgRGBA(40, 120, 220 - i * 4, 255);
+            }
+
+            state.Pause();
+            nvgBeginFrame(vg, 1280.0f, 720.0f, 1.0f);
+            nvgFillColor(vg, nvgRGBA(255, 255, 255, 255));
+            state.Resume();
+
+            for (uint64_t i = 0; i < state.iterations; i++) {
+                nvgBeginPath(vg);
+                nvgRoundedRect(vg, 10.0f, 10.0f, 200.0f, 18.0f, 6.0f);
+                nvgFillInstances(vg, xforms, colors, InstanceCount);
+
+                /* Keep the recorded frame bounded without timing the restart. */
+                if ((i + 1) % CallsPerFrame == 0) {
+                    state.Pause();
+                    nvgCancelFrame(vg);
+                    nvgBeginFrame(vg, 1280.0f, 720.0f, 1.0f);
+                    state.Resume();
+                }
+            }
+
+            state.Pause();
+            nvgCancelFrame(vg);
+            state.Resume();
+        }});
+
+        const struct {
+            const char *name;
+            int value;
+        } joins[] = {
+            { "miter", NVG_MITER },
+            { "round", NVG_ROUND },
+            { "bevel", NVG_BEVEL },
+        }, caps[] = {
+            { "butt",   NVG_BUTT   },
+            { "round",  NVG_ROUND  },
+            { "square", NVG_SQUARE },
+        };
+
+        for (const auto &join : joins) {
+            for (const auto &cap : caps) {
+                const std::string name = std::string("nvg__expandStroke/") + join.name + "-" + cap.name;
+                benchmarks.push_back({name, [vg, with_path, join = join.value, cap = cap.value](State &state) {
+                    state.Pause();
+                    with_path(AddStrokePath);
+                    benchFlattenPaths(vg);
+                    state.Resume();
+                    for (uint64_t i = 0; i < state.iterations; i++) {
+                        benchExpandStroke(vg, 6.0f, cap, join);
+                    }
+                }});
+            }
+        }
+    }
+
+    void AddTextBenchmarks(std::vector<Benchmark> &benchmarks, NVGcontext *vg, int font) {
+        benchmarks.push_back({"nvgText/line", [vg, font](State &state) {
+            constexpr uint64_t CallsPerFrame = 256;
+
+            state.Pause();
+            nvgBeginFrame(vg, 1280.0f, 720.0f, 1.0f);
+            nvgFontFaceId(vg, font);
+            nvgFontSize(vg, 18.0f);
+            nvgFillColor(vg, nvgRGBA(255, 255, 255, 255));
+            state.Resume();
+
+            for (uint64_t i = 0; i < state.iterations; i++) {
+                nvgText(vg, 10.0f, 20.0f + static_cast<float>(i % 32) * 20.0f, "The quick brown fox jumps over the lazy dog", nullptr);
+
+                /* Keep the recorded frame bounded without timing the restart. */
+                if ((i + 1) % CallsPerFrame == 0) {
+                    state.Pause();
+                    nvgCancelFrame(vg);
+                    nvgBeginFrame(vg, 1280.0f, 720.0f, 1.0f);
+                    nvgFontFaceId(vg, font);
+                    nvgFontSize(vg, 18.0f);
+                    state.Resume();
+                }
+            }
+
+            state.Pause();
+            nvgCancelFrame(vg);
+            state.Resume();
+        }});
+
+        benchmarks.push_back({"fonsTextIterNext/paragraph", [vg, font](State &state) {
+            state.Pause();
+            nvgFontFaceId(vg, font);
+            nvgFontSize(vg, 18.0f);
+            state.Resume();
+            for (uint64_t i = 0; i < state.iterations; i++) {
+                benchTextIter(vg, Paragraph, nullptr);
+            }
+        }});
+
+        benchmarks.push_back({"nvgTextBreakLines/paragraph", [vg, font](State &state) {
+            NVGtextRow rows[16];
+
+            state.Pause();
+            nvgFontFaceId(vg, font);
+            nvgFontSize(vg, 18.0f);
+            state.Resume();
+            for (uint64_t i = 0; i < state.iterations; i++) {
+                const char *start = Paragraph;
+                int count;
+                while ((count = nvgTextBreakLines(vg, start, nullptr, 240.0f, rows, 16)) > 0) {
+                    start = rows[count - 1].next;
+                }
+            }
+        }});
+
+        benchmarks.push_back({"fons__getGlyph/hit", [vg, font](State &state) {
+            for (uint64_t i = 0; i < state.iterations; i++) {
+                benchGetGlyph(vg, font, 'A' + static_cast<unsigned>(i % 26), 180);
+            }
+        }});
+
+        /* Walks (size, codepoint) pairs in an order that never repeats before the atlas fills up, so
+           every lookup rasterizes. The atlas reset that follows a full atlas is timed, amortized over
+           the glyphs that fit in it. */
+        benchmarks.push_back({"fons__getGlyph/miss", [vg, font](State &state) {
+            constexpr unsigned FirstCodepoint = 0x21;
+            constexpr unsigned CodepointCount = 0x7e - FirstCodepoint;
+
+            state.Pause();
+            benchResetAtlas(vg);
+            state.Resume();
+
+            for (uint64_t i = 0; i < state.iterations; i++) {
+                const unsigned codepoint = FirstCodepoint + static_cast<unsigned>(i % CodepointCount);
+                const short isize = static_cast<short>(100 + (i / CodepointCount) % 200);
+                if (!benchGetGlyph(vg, font, codepoint, isize)) {
+                    benchResetAtlas(vg);
+                    benchGetGlyph(vg, font, codepoint, isize);
+                }
+            }
+        }});
+    }
+
+    void AddMemPoolBenchmarks(std::vector<Benchmark> &benchmarks, CMemPool &pool) {
+        static constexpr size_t LiveCount = 256;
+
+        const auto next_size = [](Random &random) {
+            /* Mostly small uniform/vertex sized blocks with the occasional large one. */
+            const uint32_t r = random.Next();
+            return (r & 7) == 0 ? 0x1000 + (r >> 3) % 0x20000 : 0x40 + (r >> 3) % 0x1000;
+        };
+
+        const auto next_alignment = [](Random &random) {
+            return (random.Next() & 3) == 0 ? 0x100u : static_cast<uint32_t>(DK_CMDMEM_ALIGNMENT);
+        };
+
+        const auto shuffle = [](std::vector<CMemPool::Handle> &handles, Random &random) {
+            for (size_t i = handles.size(); i > 1; i--) {
+                std::swap(handles[i - 1], handles[random.Next() % i]);
+            }
+        };
+
+        benchmarks.push_back({"CMemPool::allocate", [&pool, next_size, next_alignment, shuffle](State &state) {
+            std::vector<CMemPool::Handle> handles;
+            Random random(1);
+
+            state.Pause();
+            handles.reserve(LiveCount);
+            state.Resume();
+
+            for (uint64_t i = 0; i < state.iterations; i++) {
+                handles.push_back(pool.allocate(next_size(random), next_alignment(random)));
+                if (handles.size() == LiveCount || i + 1 == state.iterations) {
+                    state.Pause();
+                    shuffle(handles, random);
+                    for (auto &handle : handles) {
+                        handle.destroy();
+                    }
+                    handles.clear();
+                    state.Resume();
+                }
+            }
+        }});
+
+        benchmarks.push_back({"CMemPool::_destroy", [&pool, next_size, next_alignment, shuffle](State &state) {
+            std::vector<CMemPool::Handle> handles;
+            Random random(2);
+
+            for (uint64_t i = 0; i < state.iterations; i++) {
+                if (handles.empty()) {
+                    state.Pause();
+                    const uint64_t count = std::min<uint64_t>(LiveCount, state.iterations - i);
+                    for (uint64_t j = 0; j < count; j++) {
+                        handles.push_back(pool.allocate(next_size(random), next_alignment(random)));
+                    }
+                    shuffle(handles, random);
+                    state.Resume();
+                }
+
+                handles.back().destroy();
+                handles.pop_back();
+            }
+        }});
+
+        /* Replaces a random live allocation each iteration, exercising the free list under fragmentation. */
+        benchmarks.push_back({"CMemPool::allocate+_destroy/churn", [&pool, next_size, next_alignment](State &state) {
+            std::vector<CMemPool::Handle> handles;
+            Random random(3);
+
+            state.Pause();
+            for (size_t i = 0; i < LiveCount; i++) {
+                handles.push_back(pool.allocate(next_size(random), next_alignment(random)));
+            }
+            state.Resume();
+
+            for (uint64_t i = 0; i < state.iterations; i++) {
+                CMemPool::Handle &handle = handles[random.Next() % LiveCount];
+                handle.destroy();
+                handle = pool.allocate(next_size(random), next_alignment(random));
+            }
+
+            state.Pause();
+            for (auto &handle : handles) {
+                handle.destroy();
+            }
+            state.Resume();
+        }});
+    }
+
+    bool ParseOptions(int argc, char **argv, Options &options) {
+        for (int i = 1; i < argc; i++) {
+            const bool has_value = i + 1 < argc;
+            if (std::strcmp(argv[i], "--filter") == 0 && has_value) {
+                options.filter = argv[++i];
+            } else if (std::strcmp(argv[i], "--font") == 0 && has_value) {
+                options.font_path = argv[++i];
+            } else if (std::strcmp(argv[i], "--min-time") == 0 && has_value) {
+                options.min_time = std::atof(argv[++i]) / 1000.0;
+            } else if (std::strcmp(argv[i], "--repetitions") == 0 && has_value) {
+                options.repetitions = std::max(1, std::atoi(argv[++i]));
+            } else {
+                std::fprintf(stderr, "usage: %s [--filter substring] [--font path] [--min-time ms] [--repetitions n]\n", argv[0]);
+                return false;
+            }
+        }
+        return true;
+    }
+
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        return EXIT_FAILURE;
+    }
+
+    nvg::NullRenderer renderer;
+    NVGcontext *vg = nvgCreateNull(&renderer, NVG_ANTIALIAS | NVG_STENCIL_STROKES);
+    if (vg == nullptr) {
+        std::fprintf(stderr, "Failed to create the nanovg context\n");
+        return EXIT_FAILURE;
+    }
+
+    CMemPool pool(dk::Device{});
+
+    std::vector<Benchmark> benchmarks;
+    AddPathBenchmarks(benchmarks, vg);
+
+    const int font = nvgCreateFont(vg, "sans", options.font_path);
+    if (font >= 0) {
+        AddTextBenchmarks(benchmarks, vg, font);
+    } else {
+        std::fprintf(stderr, "Could not load %s, skipping the text benchmarks (see --font)\n", options.font_path);
+    }
+
+    AddMemPoolBenchmarks(benchmarks, pool);
+
+    std::printf("%-36s %12s %10s %12s %8s\n", "benchmark", "ns/op", "allocs/op", "iterations", "spread");
+    for (const Benchmark &benchmark : benchmarks) {
+        if (options.filter != nullptr && benchmark.name.find(options.filter) == std::string::npos) {
+            continue;
+        }
+
+        const Result result = Run(benchmark, options);
+        std::printf("%-36s %12.1f %10.3f %12llu %7.1f%%\n", benchmark.name.c_str(), result.ns_per_op,
+            result.allocs_per_op, static_cast<unsigned long long>(result.iterations), result.spread * 100.0);
+        std::fflush(stdout);
+    }
+
+    nvgDeleteNull(vg);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,81 @@
+//
+// Compiles nanovg.c into this translation unit so the benchmarks can reach its static helpers.
+// The library sources are left untouched; this file is only part of the host benchmark build.
+//
+
+#include "../source/nanovg.c"
+#include "bench_internal.h"
+
+void benchFlattenPaths(NVGcontext* ctx)
+{
+	nvg__clearPathCache(ctx);
+	nvg__flattenPaths(ctx);
+}
+
+int benchExpandFill(NVGcontext* ctx)
+{
+	NVGstate* state = nvg__getState(ctx);
+	float w = ctx->params.edgeAntiAlias && state->shapeAntiAlias ? ctx->fringeWidth : 0.0f;
+	int i, nverts = 0;
+
+	nvg__expandFill(ctx, w, NVG_MITER, 2.4f);
+	for (i = 0; i < ctx->cache->npaths; i++)
+		nverts += ctx->cache->paths[i].nfill + ctx->cache->paths[i].nstroke;
+	return nverts;
+}
+
+int benchExpandStroke(NVGcontext* ctx, float strokeWidth, int lineCap, int lineJoin)
+{
+	NVGstate* state = nvg__getState(ctx);
+	float fringe = ctx->params.edgeAntiAlias && state->shapeAntiAlias ? ctx->fringeWidth : 0.0f;
+	int i, nverts = 0;
+
+	nvg__expandStroke(ctx, strokeWidth*0.5f, fringe, lineCap, lineJoin, state->miterLimit);
+	for (i = 0; i < ctx->cache->npaths; i++)
+		nverts += ctx->cache->paths[i].nstroke;
+	return nverts;
+}
+
+int benchTesselateBezier(NVGcontext* ctx, float x1, float y1, float x2, float y2,
+						 float x3, float y3, float x4, float y4)
+{
+	nvg__clearPathCache(ctx);
+	nvg__addPath(ctx);
+	nvg__addPoint(ctx, x1, y1, NVG_PT_CORNER);
+	nvg__tesselateBezier(ctx, x1,y1, x2,y2, x3,y3, x4,y4, 0, NVG_PT_CORNER);
+	return ctx->cache->npoints;
+}
+
+int benchGetGlyph(NVGcontext* ctx, int font, unsigned int codepoint, short isize)
+{
+	FONScontext* stash = ctx->fs;
+	if (font < 0 || font >= stash->nfonts) return 0;
+	return fons__getGlyph(stash, stash->fonts[font], codepoint, isize, 0, FONS_GLYPH_BITMAP_REQUIRED) != NULL;
+}
+
+void benchResetAtlas(NVGcontext* ctx)
+{
+	int w = 0, h = 0;
+	fonsGetAtlasSize(ctx->fs, &w, &h);
+	fonsResetAtlas(ctx->fs, w, h);
+}
+
+int benchTextIter(NVGcontext* ctx, const char* string, const char* end)
+{
+	NVGstate* state = nvg__getState(ctx);
+	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
+	FONStextIter iter;
+	FONSquad q;
+	int nquads = 0;
+
+	fonsSetSize(ctx->fs, state->fontSize*scale);
+	fonsSetSpacing(ctx->fs, state->letterSpacing*scale);
+	fonsSetBlur(ctx->fs, state->fontBlur*scale);
+	fonsSetAlign(ctx->fs, state->textAlign);
+	fonsSetFont(ctx->fs, state->fontId);
+
+	fonsTextIterInit(ctx->fs, &iter, 0, 0, string, end, FONS_GLYPH_BITMAP_REQUIRED);
+	while (fonsTextIterNext(ctx->fs, &iter, &q))
+		nquads++;
+	return nquads;
+}
@@ -0,0 +1,41 @@
+#ifndef NANOVG_BENCH_INTERNAL_H
+#define NANOVG_BENCH_INTERNAL_H
+
+#include "nanovg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Entry points into the static helpers of nanovg.c and fontstash.h, which bench_internal.c
+// compiles into the same translation unit so they can be timed on their own.
+
+// Flattens the current path of ctx into its path cache, dropping whatever the cache held.
+void benchFlattenPaths(NVGcontext* ctx);
+
+// Expands the flattened paths the way nvgFill does. Returns the number of vertices written.
+int benchExpandFill(NVGcontext* ctx);
+
+// Expands the flattened paths the way nvgStroke does. Returns the number of vertices written.
+int benchExpandStroke(NVGcontext* ctx, float strokeWidth, int lineCap, int lineJoin);
+
+// Tessellates a single cubic bezier into a fresh path. Returns the number of points produced.
+int benchTesselateBezier(NVGcontext* ctx, float x1, float y1, float x2, float y2,
+						 float x3, float y3, float x4, float y4);
+
+// Looks up a glyph of font at the size in tenths of a pixel, rasterizing it into the atlas on a miss.
+// Returns 0 when the atlas has no room left for it.
+int benchGetGlyph(NVGcontext* ctx, int font, unsigned int codepoint, short isize);
+
+// Empties the font atlas and every glyph cache.
+void benchResetAtlas(NVGcontext* ctx);
+
+// Runs the fontstash iterator nvgText uses over string with the current font state.
+// Returns the number of quads produced.
+int benchTextIter(NVGcontext* ctx, const char* string, const char* end);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NANOVG_BENCH_INTERNAL_H
@@ -0,0 +1,817 @@
+/*
+** Host rendering checks for nanovg-deko3d. Fixed scenes are drawn through SwRenderer, which follows
+** the passes, stencil setup and shaders of DkRenderer, and compared against the golden images in
+** golden/. A few checks instead draw the same thing two ways that must agree. See the Makefile next
+** to this file for how to build and run them.
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "nanovg_sw.h"
+#include "nanovg_capture.h"
+
+namespace {
+
+    constexpr int ImageSize = 96;
+
+    /* SwRenderer is deterministic for a given build, but compilers may contract or reorder the float
+       maths of shading differently. A couple of levels per channel are let through for that, coverage
+       or stencil mistakes show up far above it. */
+    constexpr int MaxChannelDiff = 2;
+
+    struct Options {
+        const char *filter = nullptr;
+        const char *font_path = "../../romfs/fonts/Roboto-Regular.ttf";
+        const char *golden_dir = "golden";
+        const char *output_dir = "build";
+        bool update = false;
+    };
+
+    /* Resources scenes may draw with, created for each context. The font is -1 if it could not be loaded. */
+    struct Assets {
+        int image;
+        int font;
+    };
+
+    using DrawFunc = std::function<void(NVGcontext *, const Assets &)>;
+
+    /* Premultiplied RGBA8 pixels, row by row from the top, as SwRenderer produces them. */
+    struct Image {
+        int width = 0;
+        int height = 0;
+        std::vector<uint8_t> pixels;
+    };
+
+    /* A scene drawn once and compared against golden/<name>.pam. */
+    struct Scene {
+        std::string name;
+        int flags;
+        DrawFunc draw;
+        bool uses_font = false;
+    };
+
+    /* A check which compares two renders of its own, filling in detail either way. */
+    struct Check {
+        std::string name;
+        std::function<bool(const Options &, std::string &)> run;
+    };
+
+    Assets LoadAssets(NVGcontext *vg, const Options &options) {
+        /* Two-tone checker, small enough that sampling and wrapping are both visible. */
+        uint8_t checker[8 * 8 * 4];
+        for (int i = 0; i < 8 * 8; i++) {
+            const bool odd = ((i % 8) / 2 + (i / 8) / 2) & 1;
+            const uint8_t texel[4] = { static_cast<uint8_t>(odd ? 240 : 40), static_cast<uint8_t>(odd ? 120 : 200), 60, 255 };
+            std::memcpy(&checker[i * 4], texel, sizeof(texel));
+        }
+
+        Assets assets;
+        assets.image = nvgCreateImageRGBA(vg, 8, 8, NVG_IMAGE_REPEATX | NVG_IMAGE_REPEATY, checker);
+        assets.font = nvgCreateFont(vg, "sans", options.font_path);
+        return assets;
+    }
+
+    void DrawFrame(NVGcontext *vg, nvg::SwRenderer &renderer, const Assets &assets, const DrawFunc &draw) {
+        renderer.Clear(nvgRGBA(32, 32, 40, 255));
+        nvgBeginFrame(vg, ImageSize, ImageSize, 1.0f);
+        draw(vg, assets);
+        nvgEndFrame(vg);
+    }
+
+    Image GetImage(const nvg::SwRenderer &renderer) {
+        Image image;
+        image.width = renderer.GetWidth();
+        image.height = renderer.GetHeight();
+        image.pixels.assign(renderer.GetPixels(), renderer.GetPixels() + image.width * image.height * 4);
+        return image;
+    }
+
+    Image Render(const Options &options, int flags, unsigned thread_count, const DrawFunc &draw) {
+        nvg::SwRenderer renderer(ImageSize, ImageSize, thread_count);
+        NVGcontext *vg = nvgCreateSw(&renderer, flags);
+
+        DrawFrame(vg, renderer, LoadAssets(vg, options), draw);
+        const Image image = GetImage(renderer);
+
+        nvgDeleteSw(vg);
+        return image;
+    }
+
+    /* Golden images are stored as PAM, which is simple enough to need no library and is read by most image tools. */
+    bool WritePam(const std::string &path, const Image &image) {
+        FILE *f = std::fopen(path.c_str(), "wb");
+        if (f == nullptr) {
+            return false;
+        }
+
+        std::fprintf(f, "P7\nWIDTH %d\nHEIGHT %d\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", image.width, image.height);
+        const bool written = std::fwrite(image.pixels.data(), 1, image.pixels.size(), f) == image.pixels.size();
+        return std::fclose(f) == 0 && written;
+    }
+
+    bool ReadPam(const std::string &path, Image &image) {
+        FILE *f = std::fopen(path.c_str(), "rb");
+        if (f == nullptr) {
+            return false;
+        }
+
+        char line[64];
+        int depth = 0, max_value = 0;
+        bool ok = std::fgets(line, sizeof(line), f) != nullptr && std::strcmp(line, "P7\n") == 0;
+        while (ok && std::fgets(line, sizeof(line), f) != nullptr && std::strcmp(line, "ENDHDR\n") != 0) {
+            std::sscanf(line, "WIDTH %d", &image.width);
+            std::sscanf(line, "HEIGHT %d", &image.height);
+            std::sscanf(line, "DEPTH %d", &depth);
+            std::sscanf(line, "MAXVAL %d", &max_value);
+        }
+
+        ok = ok && depth == 4 && max_value == 255 && image.width > 0 && image.height > 0;
+        if (ok) {
+            image.pixels.resize(image.width * image.height * 4);
+            ok = std::fread(image.pixels.data(), 1, image.pixels.size(), f) == image.pixels.size();
+        }
+
+        std::fclose(f);
+        return ok;
+    }
+
+    /* Compares two renders of the same size. Returns false if any channel of any pixel differs by more than
+       max_diff, describing the differences found in detail. */
+    bool Compare(const Image &expected, const Image &actual, int max_diff, std::string &detail) {
+        if (expected.width != actual.width || expected.height != actual.height) {
+            detail = "size differs";
+            return false;
+        }
+
+        int largest = 0, pixels = 0;
+        for (size_t i = 0; i < actual.pixels.size(); i += 4) {
+            int diff = 0;
+            for (size_t c = 0; c < 4; c++) {
+                diff = std::max(diff, std::abs(static_cast<int>(expected.pixels[i + c]) - static_cast<int>(actual.pixels[i + c])));
+            }
+            largest = std::max(largest, diff);
+            pixels += diff > max_diff;
+        }
+
+        char buffer[96];
+        if (pixels > 0) {
+            std::snprintf(buffer, sizeof(buffer), "%d pixels differ, by up to %d", pixels, largest);
+        } else {
+            std::snprintf(buffer, sizeof(buffer), largest > 0 ? "matches, within %d" : "identical", largest);
+        }
+        detail = buffer;
+        return pixels == 0;
+    }
+
+    bool RunScene(const Scene &scene, const Options &options, std::string &detail) {
+        if (scene.uses_font) {
+            FILE *f = std::fopen(options.font_path, "rb");
+            if (f == nullptr) {
+                detail = std::string("could not open ") + options.font_path + " (see --font)";
+                return false;
+            }
+            std::fclose(f);
+        }
+
+        const Image actual = Render(options, scene.flags, 0, scene.draw);
+        const std::string golden_path = std::string(options.golden_dir) + "/" + scene.name + ".pam";
+
+        if (options.update) {
+            detail = WritePam(golden_path, actual) ? "updated" : "could not write " + golden_path;
+            return detail == "updated";
+        }
+
+        Image golden;
+        bool ok;
+        if (!ReadPam(golden_path, golden)) {
+            detail = "no golden image, run with --update to create it";
+            ok = false;
+        } else {
+            ok = Compare(golden, actual, MaxChannelDiff, detail);
+        }
+
+        /* Keep the failing render next to the objects, for comparing by eye. */
+        if (!ok) {
+            const std::string output_path = std::string(options.output_dir) + "/" + scene.name + ".pam";
+            if (WritePam(output_path, actual)) {
+                detail += ", see " + output_path;
+            }
+        }
+        return ok;
+    }
+
+    /* Image ids are handed out by each back-end, so the calls only have to agree on whether they use one. */
+    bool SameCalls(const std::vector<DKNVGcall> &expected, const std::vector<DKNVGcall> &actual) {
+        if (expected.size() != actual.size()) {
+            return false;
+        }
+
+        for (size_t i = 0; i < expected.size(); i++) {
+            DKNVGcall a = expected[i], b = actual[i];
+            if ((a.image != 0) != (b.image != 0)) {
+                return false;
+            }
+            a.image = b.image = 0;
+            if (std::memcmp(&a, &b, sizeof(DKNVGcall)) != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /* Only the uniforms themselves are compared, the padding after each block is never written. */
+    bool SameUniforms(const std::vector<uint8_t> &expected, const std::vector<uint8_t> &actual, size_t block_size) {
+        if (expected.size() != actual.size()) {
+            return false;
+        }
+
+        for (size_t offset = 0; offset < expected.size(); offset += block_size) {
+            if (std::memcmp(&expected[offset], &actual[offset], sizeof(DKNVGfragUniforms)) != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template <typename T>
+    bool SameData(const std::vector<T> &expected, const std::vector<T> &actual) {
+        return expected.size() == actual.size() && (expected.empty() || std::memcmp(expected.data(), actual.data(), expected.size() * sizeof(T)) == 0);
+    }
+
+    /* Records a frame of the scene while drawing it, then replays the trace into a second context. The
+       replayed frame must reach the back-end exactly as the recorded one did, and draw the same pixels. */
+    bool RunCaptureReplay(const Scene &scene, const Options &options, std::string &detail) {
+        const std::string trace_path = std::string(options.output_dir) + "/" + scene.name + ".nvgtrace";
+
+        nvg::SwRenderer recorded_renderer(ImageSize, ImageSize), replayed_renderer(ImageSize, ImageSize);
+        NVGcontext *recorded = nvgCreateSw(&recorded_renderer, scene.flags);
+        NVGcontext *replayed = nvgCreateSw(&replayed_renderer, scene.flags);
+
+        /* Started before the assets are loaded, so that the trace carries the contents of the image. */
+        NVGcapture *capture = nvgCaptureBegin(recorded, trace_path.c_str());
+        if (capture == nullptr) {
+            detail = "could not create " + trace_path;
+            nvgDeleteSw(recorded);
+            nvgDeleteSw(replayed);
+            return false;
+        }
+        DrawFrame(recorded, recorded_renderer, LoadAssets(recorded, options), scene.draw);
+        const bool written = nvgCaptureEnd(capture);
+
+        replayed_renderer.Clear(nvgRGBA(32, 32, 40, 255));
+        const int frames = nvgReplayTrace(replayed, trace_path.c_str());
+
+        bool ok = false;
+        if (!written) {
+            detail = "could not write " + trace_path;
+        } else if (frames != 1) {
+            detail = "replayed " + std::to_string(frames) + " frames instead of 1";
+        } else if (!SameCalls(recorded_renderer.GetCalls(), replayed_renderer.GetCalls())) {
+            detail = "calls differ";
+        } else if (!SameData(recorded_renderer.GetVertices(), replayed_renderer.GetVertices())) {
+            detail = "vertices differ";
+        } else if (!SameData(recorded_renderer.GetIndices(), replayed_renderer.GetIndices())) {
+            detail = "indices differ";
+        } else if (!SameUniforms(recorded_renderer.GetUniforms(), replayed_renderer.GetUniforms(), nvg::Renderer::FragmentUniformSize)) {
+            detail = "uniforms differ";
+        } else if (!SameData(recorded_renderer.GetInstances(), replayed_renderer.GetInstances())) {
+            detail = "instances differ";
+        } else {
+            ok = Compare(GetImage(recorded_renderer), GetImage(replayed_renderer), 0, detail);
+            detail = std::to_string(recorded_renderer.GetCalls().size()) + " calls, " + detail;
+        }
+
+        nvgDeleteSw(recorded);
+        nvgDeleteSw(replayed);
+        return ok;
+    }
+
+    /* Shapes shared by the scenes. */
+
+    void AddStar(NVGcontext *vg, float cx, float cy, float inner, float outer, int points) {
+        for (int i = 0; i < points * 2; i++) {
+            const float angle = static_cast<float>(i) * NVG_PI / static_cast<float>(points) - NVG_PI * 0.5f;
+            const float radius = (i & 1) ? inner : outer;
+            const float x = cx + std::cos(angle) * radius;
+            const float y = cy + std::sin(angle) * radius;
+            if (i == 0) {
+                nvgMoveTo(vg, x, y);
+            } else {
+                nvgLineTo(vg, x, y);
+            }
+        }
+        nvgClosePath(vg);
+    }
+
+    void AddArrow(NVGcontext *vg, float x, float y) {
+        nvgMoveTo(vg, x, y + 5.0f);
+        nvgLineTo(vg, x + 10.0f, y + 5.0f);
+        nvgLineTo(vg, x + 10.0f, y);
+        nvgLineTo(vg, x + 18.0f, y + 8.0f);
+        nvgLineTo(vg, x + 10.0f, y + 16.0f);
+        nvgLineTo(vg, x + 10.0f, y + 11.0f);
+        nvgLineTo(vg, x, y + 11.0f);
+        nvgClosePath(vg);
+    }
+
+    void AddZigzag(NVGcontext *vg, float x, float y, float step, int count) {
+        nvgMoveTo(vg, x, y);
+        for (int i = 1; i <= count; i++) {
+            nvgLineTo(vg, x + static_cast<float>(i) * step, (i & 1) ? y + 14.0f : y);
+        }
+    }
+
+    /* Scenes. Each one stays within ImageSize and sticks to the paths it is named after. */
+
+    void DrawConvexFills(NVGcontext *vg, const Assets &) {
+        nvgBeginPath(vg);
+        nvgMoveTo(vg, 8.0f, 10.0f);
+        nvgLineTo(vg, 44.0f, 6.0f);
+        nvgLineTo(vg, 30.0f, 42.0f);
+        nvgClosePath(vg);
+        nvgFillColor(vg, nvgRGBA(220, 80, 60, 255));
+        nvgFill(vg);
+
+        nvgBeginPath(vg);
+        for (int i = 0; i < 6; i++) {
+            const float angle = static_cast<float>(i) * NVG_PI / 3.0f + 0.2f;
+            const float x = 70.0f + std::cos(angle) * 18.0f, y = 26.0f + std::sin(angle) * 18.0f;
+            if (i == 0) {
+                nvgMoveTo(vg, x, y);
+            } else {
+                nvgLineTo(vg, x, y);
+            }
+        }
+        nvgClosePath(vg);
+        nvgFillColor(vg, nvgRGBA(80, 200, 120, 255));
+        nvgFill(vg);
+
+        /* Translucent fills overlapping each other, which consecutive compatible calls are merged into. */
+        for (int i = 0; i < 4; i++) {
+            const float x = 10.0f + static_cast<float>(i) * 16.0f;
+            nvgBeginPath(vg);
+            nvgMoveTo(vg, x, 56.0f);
+            nvgLineTo(vg, x + 26.0f, 52.0f);
+            nvgLineTo(vg, x + 22.0f, 88.0f);
+            nvgLineTo(vg, x + 2.0f, 84.0f);
+            nvgClosePath(vg);
+            nvgFillColor(vg, nvgRGBA(90, 140, 255, 140));
+            nvgFill(vg);
+        }
+    }
+
+    void DrawConcaveFills(NVGcontext *vg, const Assets &) {
+        /* Too many vertices to be triangulated, so always drawn through the stencil. */
+        nvgBeginPath(vg);
+        AddStar(vg, 28.0f, 28.0f, 10.0f, 24.0f, 40);
+        nvgFillColor(vg, nvgRGBA(240, 200, 60, 255));
+        nvgFill(vg);
+
+        /* Small enough to be triangulated. */
+        nvgBeginPath(vg);
+        AddStar(vg, 72.0f, 24.0f, 8.0f, 20.0f, 5);
+        nvgFillColor(vg, nvgRGBA(220, 90, 200, 255));
+        nvgFill(vg);
+
+        nvgBeginPath(vg);
+        AddArrow(vg, 8.0f, 60.0f);
+        AddArrow(vg, 8.0f, 76.0f);
+        nvgFillColor(vg, nvgRGBA(120, 220, 240, 255));
+        nvgFill(vg);
+
+        /* Holes and self intersections, which depend on the winding rule. */
+        nvgBeginPath(vg);
+        nvgRect(vg, 34.0f, 54.0f, 26.0f, 36.0f);
+        nvgRect(vg, 40.0f, 60.0f, 14.0f, 12.0f);
+        nvgPathWinding(vg, NVG_HOLE);
+        nvgFillColor(vg, nvgRGBA(250, 130, 70, 200));
+        nvgFill(vg);
+
+        nvgBeginPath(vg);
+        nvgMoveTo(vg, 64.0f, 54.0f);
+        nvgLineTo(vg, 90.0f, 90.0f);
+        nvgLineTo(vg, 90.0f, 54.0f);
+        nvgLineTo(vg, 64.0f, 90.0f);
+        nvgClosePath(vg);
+        nvgFillColor(vg, nvgRGBA(140, 250, 110, 220));
+        nvgFill(vg);
+    }
+
+    /* Fills covering pixels with many windings of the same direction, which must neither wrap around to
+       zero nor lose track of the stroke marks sharing the stencil with them. */
+    void DrawDeepWindings(NVGcontext *vg, const Assets &) {
+        nvgStrokeWidth(vg, 3.0f);
+        for (int i = 0; i < 5; i++) {
+            nvgBeginPath(vg);
+            AddZigzag(vg, 4.0f, 4.0f + static_cast<float>(i) * 18.0f, 8.0f, 11);
+            nvgStrokeColor(vg, nvgRGBA(120, 120, 140, 160));
+            nvgStroke(vg);
+        }
+
+        const int windings[] = { 16, 32, 48 };
+        for (int column = 0; column < 3; column++) {
+            const float x = 6.0f + static_cast<float>(column) * 30.0f;
+
+            /* The same rect over and over, every pixel of it at the full count. */
+            nvgBeginPath(vg);
+            for (int i = 0; i < windings[column]; i++) {
+                nvgRect(vg, x, 8.0f, 24.0f, 30.0f);
+            }
+            nvgFillColor(vg, nvgRGBA(250, 190, 80, 230));
+            nvgFill(vg);
+
+            /* Nested rects, counting up towards the middle. */
+            nvgBeginPath(vg);
+            for (int i = 0; i < windings[column]; i++) {
+                const float inset = static_cast<float>(i) * 10.0f / static_cast<float>(windings[column]);
+                nvgRect(vg, x + inset, 50.0f + inset, 24.0f - inset * 2.0f, 38.0f - inset * 2.0f);
+            }
+            nvgFillColor(vg, nvgRGBA(90, 200, 250, 230));
+            nvgFill(vg);
+        }
+    }
+
+    void DrawStencilStrokes(NVGcontext *vg, const Assets &) {
+        /* More strokes than there are stroke stencil values, so the reference wraps around within the frame. */
+        nvgStrokeWidth(vg, 3.0f);
+        nvgLineJoin(vg, NVG_MITER);
+        for (int i = 0; i < 20; i++) {
+            nvgBeginPath(vg);
+            AddZigzag(vg, 6.0f + static_cast<float>(i % 3), 4.0f + static_cast<float>(i) * 3.5f, 7.0f, 12);
+            nvgStrokeColor(vg, nvgRGBA(80 + i * 8, 200 - i * 6, 120 + i * 5, 150));
+            nvgStroke(vg);
+        }
+
+        /* Self overlapping, translucent, so any double blending shows. */
+        nvgBeginPath(vg);
+        nvgArc(vg, 60.0f, 60.0f, 20.0f, 0.0f, NVG_PI * 1.75f, NVG_CW);
+        nvgLineTo(vg, 40.0f, 40.0f);
+        nvgStrokeWidth(vg, 8.0f);
+        nvgLineCap(vg, NVG_ROUND);
+        nvgLineJoin(vg, NVG_ROUND);
+        nvgStrokeColor(vg, nvgRGBA(255, 255, 255, 128));
+        nvgStroke(vg);
+    }
+
+    /* Strokes which can't overlap themselves, drawn in a single pass even with stencil strokes. */
+    void DrawSimpleStrokes(NVGcontext *vg, const Assets &) {
+        for (int i = 0; i < 6; i++) {
+            nvgBeginPath(vg);
+            nvgMoveTo(vg, 6.0f, 8.0f + static_cast<float>(i) * 6.0f);
+            nvgLineTo(vg, 90.0f, 4.0f + static_cast<float>(i) * 8.0f);
+            nvgStrokeWidth(vg, 0.5f + static_cast<float>(i) * 0.7f);
+            nvgStrokeColor(vg, nvgRGBA(255, 220, 120, 180));
+            nvgStroke(vg);
+        }
+
+        nvgBeginPath(vg);
+        nvgRect(vg, 8.5f, 58.5f, 30.0f, 30.0f);
+        nvgRect(vg, 46.5f, 58.5f, 12.0f, 30.0f);
+        nvgStrokeWidth(vg, 2.0f);
+        nvgStrokeColor(vg, nvgRGBA(120, 200, 255, 200));
+        nvgStroke(vg);
+
+        nvgBeginPath(vg);
+        nvgCircle(vg, 76.0f, 72.0f, 14.0f);
+        nvgStrokeWidth(vg, 5.0f);
+        nvgStrokeColor(vg, nvgRGBA(255, 100, 160, 160));
+        nvgStroke(vg);
+    }
+
+    void DrawGradients(NVGcontext *vg, const Assets &) {
+        nvgBeginPath(vg);
+        nvgRect(vg, 4.0f, 4.0f, 42.0f, 40.0f);
+        nvgFillPaint(vg, nvgLinearGradient(vg, 4.0f, 4.0f, 46.0f, 44.0f, nvgRGBA(255, 60, 60, 255), nvgRGBA(60, 60, 255, 120)));
+        nvgFill(vg);
+
+        nvgBeginPath(vg);
+        nvgCircle(vg, 72.0f, 24.0f, 20.0f);
+        nvgFillPaint(vg, nvgRadialGradient(vg, 66.0f, 18.0f, 2.0f, 22.0f, nvgRGBA(255, 255, 255, 255), nvgRGBA(40, 120, 60, 255)));
+        nvgFill(vg);
+
+        nvgBeginPath(vg);
+        nvgRoundedRect(vg, 6.0f, 52.0f, 40.0f, 38.0f, 8.0f);
+        nvgFillPaint(vg, nvgBoxGradient(vg, 10.0f, 56.0f, 32.0f, 30.0f, 6.0f, 10.0f, nvgRGBA(250, 200, 80, 255), nvgRGBA(0, 0, 0, 0)));
+        nvgFill(vg);
+
+        nvgBeginPath(vg);
+        AddStar(vg, 72.0f, 70.0f, 9.0f, 22.0f, 7);
+        nvgFillPaint(vg, nvgLinearGradient(vg, 50.0f, 48.0f, 94.0f, 92.0f, nvgRGBA(120, 255, 200, 255), nvgRGBA(200, 40, 250, 255)));
+        nvgFill(vg);
+    }
+
+    void DrawImages(NVGcontext *vg, const Assets &assets) {
+        nvgBeginPath(vg);
+        nvgRect(vg, 4.0f, 4.0f, 40.0f, 40.0f);
+        nvgFillPaint(vg, nvgImagePattern(vg, 4.0f, 4.0f, 16.0f, 16.0f, 0.0f, assets.image, 1.0f));
+        nvgFill(vg);
+
+        nvgBeginPath(vg);
+        nvgRoundedRect(vg, 52.0f, 4.0f, 40.0f, 40.0f, 10.0f);
+        nvgFillPaint(vg, nvgImagePattern(vg, 52.0f, 4.0f, 20.0f, 20.0f, 0.5f, assets.image, 0.6f));
+        nvgFill(vg);
+
+        nvgBeginPath(vg);
+        AddStar(vg, 48.0f, 70.0f, 10.0f, 24.0f, 6);
+        nvgFillPaint(vg, nvgImagePattern(vg, 24.0f, 46.0f, 12.0f, 12.0f, -0.3f, assets.image, 1.0f));
+        nvgFill(vg);
+    }
+
+    void DrawScissored(NVGcontext *vg, const Assets &) {
+        nvgSave(vg);
+        nvgTranslate(vg, 48.0f, 48.0f);
+        nvgRotate(vg, 0.4f);
+        nvgScissor(vg, -30.0f, -20.0f, 60.0f, 40.0f);
+
+        nvgBeginPath(vg);
+        nvgRect(vg, -48.0f, -48.0f, 96.0f, 96.0f);
+        nvgFillPaint(vg, nvgLinearGradient(vg, -48.0f, 0.0f, 48.0f, 0.0f, nvgRGBA(250, 120, 60, 255), nvgRGBA(60, 120, 250, 255)));
+        nvgFill(vg);
+
+        nvgBeginPath(vg);
+        AddStar(vg, 0.0f, 0.0f, 14.0f, 34.0f, 16);
+        nvgFillColor(vg, nvgRGBA(255, 255, 255, 120));
+        nvgFill(vg);
+        nvgRestore(vg);
+
+        /* Axis aligned, cut down further by a second scissor. */
+        nvgSave(vg);
+        nvgScissor(vg, 4.0f, 4.0f, 40.0f, 30.0f);
+        nvgIntersectScissor(vg, 20.0f, 10.0f, 40.0f, 40.0f);
+        nvgBeginPath(vg);
+        AddZigzag(vg, 0.0f, 10.0f, 6.0f, 12);
+        nvgStrokeWidth(vg, 4.0f);
+        nvgStrokeColor(vg, nvgRGBA(120, 255, 120, 200));
+        nvgStroke(vg);
+        nvgRestore(vg);
+    }
+
+    /* Rectangles, rounded rectangles and circles, which are filled from their distance field. */
+    void DrawShapes(NVGcontext *vg, const Assets &) {
+        nvgBeginPath(vg);
+        nvgRect(vg, 4.3f, 4.2f, 26.0f, 18.0f);
+        nvgFillColor(vg, nvgRGBA(230, 90, 70, 255));
+        nvgFill(vg);
+
+        for (int i = 0; i < 4; i++) {
+            nvgBeginPath(vg);
+            nvgRoundedRect(vg, 36.0f + static_cast<float>(i) * 14.0f, 4.0f, 12.0f, 30.0f, static_cast<float>(i) * 2.0f);
+            nvgFillColor(vg, nvgRGBA(90, 200 - i * 30, 240, 220));
+            nvgFill(vg);
+        }
+
+        for (int i = 0; i < 5; i++) {
+            nvgBeginPath(vg);
+            nvgCircle(vg, 10.0f + static_cast<float>(i * i) * 2.0f + static_cast<float>(i) * 6.0f, 54.0f, 1.5f + static_cast<float>(i) * 3.0f);
+            nvgFillColor(vg, nvgRGBA(250, 220, 90, 200));
+            nvgFill(vg);
+        }
+
+        nvgSave(vg);
+        nvgTranslate(vg, 48.0f, 80.0f);
+        nvgRotate(vg, -0.3f);
+        nvgBeginPath(vg);
+        nvgRoundedRect(vg, -36.0f, -8.0f, 72.0f, 16.0f, 6.0f);
+        nvgFillPaint(vg, nvgLinearGradient(vg, -36.0f, 0.0f, 36.0f, 0.0f, nvgRGBA(120, 250, 160, 255), nvgRGBA(250, 90, 200, 200)));
+        nvgFill(vg);
+        nvgRestore(vg);
+    }
+
+    /* Two-by-two grids of each kind of fill, drawn as instances of a single tessellation. Each instance is
+       shrunk a little more than the previous one. */
+    std::vector<float> InstanceTransforms(float x, float y, float shrink) {
+        std::vector<float> xforms;
+        for (int i = 0; i < 4; i++) {
+            const float angle = static_cast<float>(i) * 0.35f, scale = 1.0f - static_cast<float>(i) * shrink;
+            const float c = std::cos(angle) * scale, s = std::sin(angle) * scale;
+            xforms.insert(xforms.end(), { c, s, -s, c, x + static_cast<float>(i % 2) * 22.0f, y + static_cast<float>(i / 2) * 22.0f });
+        }
+        return xforms;
+    }
+
+    const NVGcolor InstanceColors[4] = {
+        { { { 1.0f, 1.0f, 1.0f, 1.0f } } },
+        { { { 1.0f, 0.4f, 0.4f, 1.0f } } },
+        { { { 0.4f, 1.0f, 0.6f, 0.8f } } },
+        { { { 0.5f, 0.6f, 1.0f, 0.5f } } },
+    };
+
+    /* Adds the path of one kind of instanced fill, around the origin. */
+    using PathFunc = std::function<void(NVGcontext *)>;
+
+    /* Sets the fill paint of one kind of instanced fill, multiplied by the tint. */
+    using PaintFunc = std::function<void(NVGcontext *, const Assets &, NVGcolor)>;
+
+    using FillInstancesFunc = std::function<void(const PathFunc &, const PaintFunc &, const std::vector<float> &)>;
+
+    /* Draws every instanced fill of the instances scene, fill_instances filling the path at each of the transforms. */
+    void DrawInstancedFills(float shrink, const FillInstancesFunc &fill_instances) {
+        const PaintFunc warm = [](NVGcontext *vg, const Assets &, NVGcolor tint) {
+            nvgFillColor(vg, nvgRGBAf(0.98f * tint.r, 0.78f * tint.g, 0.47f * tint.b, tint.a));
+        };
+        const PaintFunc cold = [](NVGcontext *vg, const Assets &, NVGcolor tint) {
+            nvgFillColor(vg, nvgRGBAf(0.55f * tint.r, 0.9f * tint.g, 0.98f * tint.b, tint.a));
+        };
+        const PaintFunc sprite = [](NVGcontext *vg, const Assets &assets, NVGcolor tint) {
+            NVGpaint paint = nvgImagePattern(vg, -8.0f, -8.0f, 8.0f, 8.0f, 0.0f, assets.image, 1.0f);
+            paint.innerColor = paint.outerColor = tint;
+            nvgFillPaint(vg, paint);
+        };
+
+        fill_instances([](NVGcontext *vg) { nvgRoundedRect(vg, -8.0f, -6.0f, 16.0f, 12.0f, 3.0f); }, warm, InstanceTransforms(14.0f, 14.0f, shrink));
+        fill_instances([](NVGcontext *vg) { AddStar(vg, 0.0f, 0.0f, 5.0f, 11.0f, 20); }, warm, InstanceTransforms(62.0f, 14.0f, shrink));
+        fill_instances([](NVGcontext *vg) { AddArrow(vg, -9.0f, -8.0f); }, cold, InstanceTransforms(14.0f, 60.0f, shrink));
+        fill_instances([](NVGcontext *vg) { nvgRect(vg, -8.0f, -8.0f, 16.0f, 16.0f); }, sprite, InstanceTransforms(62.0f, 60.0f, shrink));
+    }
+
+    void DrawInstances(NVGcontext *vg, const Assets &assets, float shrink) {
+        DrawInstancedFills(shrink, [vg, &assets](const PathFunc &path, const PaintFunc &paint, const std::vector<float> &xforms) {
+            paint(vg, assets, nvgRGBAf(1.0f, 1.0f, 1.0f, 1.0f));
+            nvgBeginPath(vg);
+            path(vg);
+            nvgFillInstances(vg, xforms.data(), InstanceColors, static_cast<int>(xforms.size() / 6));
+        });
+    }
+
+    /* Same fills as DrawInstances, one nvgTransform and nvgFill at a time. */
+    void DrawInstancesSeparately(NVGcontext *vg, const Assets &assets, float shrink) {
+        DrawInstancedFills(shrink, [vg, &assets](const PathFunc &path, const PaintFunc &paint, const std::vector<float> &xforms) {
+            for (size_t i = 0; i < xforms.size() / 6; i++) {
+                const float *t = &xforms[i * 6];
+                nvgSave(vg);
+                nvgTransform(vg, t[0], t[1], t[2], t[3], t[4], t[5]);
+                paint(vg, assets, InstanceColors[i]);
+                nvgBeginPath(vg);
+                path(vg);
+                nvgFill(vg);
+                nvgRestore(vg);
+            }
+        });
+    }
+
+    void DrawText(NVGcontext *vg, const Assets &assets) {
+        nvgFontFaceId(vg, assets.font);
+        nvgFillColor(vg, nvgRGBA(240, 240, 240, 255));
+        nvgFontSize(vg, 13.0f);
+        nvgText(vg, 4.0f, 16.0f, "nanovg-deko3d", nullptr);
+        nvgFontSize(vg, 26.0f);
+        nvgFillColor(vg, nvgRGBA(250, 200, 90, 220));
+        nvgText(vg, 4.0f, 48.0f, "Quick", nullptr);
+        nvgFontSize(vg, 9.0f);
+        nvgFillColor(vg, nvgRGBA(140, 220, 250, 255));
+        nvgTextBox(vg, 4.0f, 64.0f, 88.0f, "The quick brown fox jumps over the lazy dog.", nullptr);
+    }
+
+    std::vector<Scene> GetScenes() {
+        constexpr int AntiAlias = NVG_ANTIALIAS | NVG_STENCIL_STROKES;
+        return {
+            {"fill-convex", AntiAlias, DrawConvexFills},
+            {"fill-convex-noaa", 0, DrawConvexFills},
+            {"fill-concave", AntiAlias, DrawConcaveFills},
+            {"fill-concave-noaa", 0, DrawConcaveFills},
+            {"fill-winding", AntiAlias, DrawDeepWindings},
+            {"fill-winding-noaa", NVG_STENCIL_STROKES, DrawDeepWindings},
+            {"stroke-stencil", AntiAlias, DrawStencilStrokes},
+            {"stroke-stencil-noaa", NVG_STENCIL_STROKES, DrawStencilStrokes},
+            {"stroke-plain", NVG_ANTIALIAS, DrawStencilStrokes},
+            {"stroke-simple", AntiAlias, DrawSimpleStrokes},
+            {"paint-gradient", AntiAlias, DrawGradients},
+            {"paint-image", AntiAlias, DrawImages},
+            {"scissor", AntiAlias, DrawScissored},
+            {"shape", AntiAlias, DrawShapes},
+            {"shape-noaa", 0, DrawShapes},
+            {"instances", AntiAlias, [](NVGcontext *vg, const Assets &assets) { DrawInstances(vg, assets, 0.1f); }},
+            {"text", AntiAlias, DrawText, true},
+        };
+    }
+
+    std::vector<Check> GetChecks() {
+        std::vector<Check> checks;
+
+        /* Tiles are shared out between threads, none of which may see another's work. */
+        checks.push_back({"threads", [](const Options &options, std::string &detail) {
+            const DrawFunc draw = [](NVGcontext *vg, const Assets &assets) {
+                DrawStencilStrokes(vg, assets);
+                DrawConcaveFills(vg, assets);
+            };
+            const int flags = NVG_ANTIALIAS | NVG_STENCIL_STROKES;
+            return Compare(Render(options, flags, 1, draw), Render(options, flags, 3, draw), 0, detail);
+        }});
+
+        /* Triangulating small concave fills must not change which pixels they cover. */
+        checks.push_back({"fill-concave/triangulated", [](const Options &options, std::string &detail) {
+            const auto draw = [](int triangulate) {
+                return [triangulate](NVGcontext *vg, const Assets &assets) {
+                    nvgInternalParams(vg)->triangulateFills = triangulate;
+                    DrawConcaveFills(vg, assets);
+                };
+            };
+            return Compare(Render(options, 0, 0, draw(0)), Render(options, 0, 0, draw(1)), 0, detail);
+        }});
+
+        /* Instances must look as if each one was drawn after its own nvgTransform. The AA fringe is sized for the
+           transform the path was built with though, so with AA the instances are only rotated and moved. */
+        for (const int flags : { 0, static_cast<int>(NVG_ANTIALIAS) }) {
+            const std::string name = flags ? "instances/separate" : "instances/separate-noaa";
+            const float shrink = flags ? 0.0f : 0.1f;
+            checks.push_back({name, [flags, shrink](const Options &options, std::string &detail) {
+                const DrawFunc separately = [shrink](NVGcontext *vg, const Assets &assets) { DrawInstancesSeparately(vg, assets, shrink); };
+                const DrawFunc instanced = [shrink](NVGcontext *vg, const Assets &assets) { DrawInstances(vg, assets, shrink); };
+                return Compare(Render(options, flags, 0, separately), Render(options, flags, 0, instanced), MaxChannelDiff, detail);
+            }});
+        }
+
+        for (const Scene &scene : GetScenes()) {
+            checks.push_back({"capture/" + scene.name, [scene](const Options &options, std::string &detail) {
+                return RunCaptureReplay(scene, options, detail);
+            }});
+        }
+
+        /* A trace which could not be written in full must be reported, not left silently cut short. */
+        checks.push_back({"capture/write-error", [](const Options &options, std::string &detail) {
+            nvg::SwRenderer renderer(ImageSize, ImageSize);
+            NVGcontext *vg = nvgCreateSw(&renderer, NVG_ANTIALIAS);
+            NVGcapture *capture = nvgCaptureBegin(vg, "/dev/full");
+            if (capture == nullptr) {
+                detail = "skipped, there is no /dev/full";
+                nvgDeleteSw(vg);
+                return true;
+            }
+
+            DrawFrame(vg, renderer, LoadAssets(vg, options), DrawConcaveFills);
+            const bool written = nvgCaptureEnd(capture);
+            nvgDeleteSw(vg);
+
+            detail = written ? "the failed writes went unreported" : "reported";
+            return !written;
+        }});
+
+        return checks;
+    }
+
+    bool ParseOptions(int argc, char **argv, Options &options) {
+        for (int i = 1; i < argc; i++) {
+            const bool has_value = i + 1 < argc;
+            if (std::strcmp(argv[i], "--filter") == 0 && has_value) {
+                options.filter = argv[++i];
+            } else if (std::strcmp(argv[i], "--font") == 0 && has_value) {
+                options.font_path = argv[++i];
+            } else if (std::strcmp(argv[i], "--golden") == 0 && has_value) {
+                options.golden_dir = argv[++i];
+            } else if (std::strcmp(argv[i], "--output") == 0 && has_value) {
+                options.output_dir = argv[++i];
+            } else if (std::strcmp(argv[i], "--update") == 0) {
+                options.update = true;
+            } else {
+                std::fprintf(stderr, "usage: %s [--filter substring] [--font path] [--golden dir] [--output dir] [--update]\n", argv[0]);
+                return false;
+            }
+        }
+        return true;
+    }
+
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Check> checks;
+    for (const Scene &scene : GetScenes()) {
+        checks.push_back({scene.name, [scene](const Options &options, std::string &detail) {
+            return RunScene(scene, options, detail);
+        }});
+    }
+    if (!options.update) {
+        const std::vector<Check> comparisons = GetChecks();
+        checks.insert(checks.end(), comparisons.begin(), comparisons.end());
+    }
+
+    int failures = 0;
+    for (const Check &check : checks) {
+        if (options.filter != nullptr && check.name.find(options.filter) == std::string::npos) {
+            continue;
+        }
+
+        std::string detail;
+        const bool ok = check.run(options, detail);
+        std::printf("%-30s %-4s  %s\n", check.name.c_str(), ok ? "ok" : "FAIL", detail.c_str());
+        std::fflush(stdout);
+        failures += !ok;
+    }
+
+    if (failures > 0) {
+        std::printf("%d check%s failed\n", failures, failures == 1 ? "" : "s");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
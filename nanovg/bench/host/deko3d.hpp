@@ -0,0 +1,69 @@
+/*
+** Host stand-in for the subset of deko3d used by CMemPool, backing memory
+** blocks with heap memory so the pool bookkeeping can be benchmarked off-device.
+*/
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef uint64_t DkGpuAddr;
+
+#define DK_GPU_ADDR_INVALID           (~0ULL)
+#define DK_MEMBLOCK_ALIGNMENT         0x1000
+#define DK_CMDMEM_ALIGNMENT           4
+#define DK_SHADER_CODE_ALIGNMENT      0x100
+#define DK_SHADER_CODE_UNUSABLE_SIZE  0x80
+
+enum
+{
+    DkMemBlockFlags_CpuUncached = 1U << 0,
+    DkMemBlockFlags_CpuCached   = 2U << 0,
+    DkMemBlockFlags_GpuUncached = 1U << 2,
+    DkMemBlockFlags_GpuCached   = 2U << 2,
+    DkMemBlockFlags_Code        = 1U << 4,
+    DkMemBlockFlags_Image       = 1U << 5,
+};
+
+namespace dk
+{
+    struct Device
+    {
+        void* m_dummy = nullptr;
+    };
+
+    class MemBlock
+    {
+        void* m_mem = nullptr;
+        uint32_t m_size = 0;
+    public:
+        MemBlock() = default;
+        MemBlock(void* mem, uint32_t size) : m_mem{mem}, m_size{size} { }
+
+        explicit operator bool() const { return m_mem != nullptr; }
+        void* getCpuAddr() const { return m_mem; }
+        DkGpuAddr getGpuAddr() const { return (DkGpuAddr)(uintptr_t)m_mem; }
+        uint32_t getSize() const { return m_size; }
+
+        void destroy()
+        {
+            ::free(m_mem);
+            m_mem = nullptr;
+            m_size = 0;
+        }
+    };
+
+    struct MemBlockMaker
+    {
+        Device m_dev;
+        uint32_t m_size;
+        uint32_t m_flags = DkMemBlockFlags_CpuUncached | DkMemBlockFlags_GpuCached;
+
+        MemBlockMaker(Device dev, uint32_t size) : m_dev{dev}, m_size{size} { }
+        MemBlockMaker& setFlags(uint32_t flags) { m_flags = flags; return *this; }
+
+        MemBlock create() const
+        {
+            return MemBlock{::aligned_alloc(DK_MEMBLOCK_ALIGNMENT, m_size), m_size};
+        }
+    };
+}
@@ -0,0 +1,21 @@
+/*
+** Host stand-in for the few libnx types the framework headers use, so the
+** benchmarks can build without devkitPro. Not a general replacement.
+*/
+#pragma once
+#include <stdint.h>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t   s8;
+typedef int16_t  s16;
+typedef int32_t  s32;
+typedef int64_t  s64;
+
+#ifdef __cplusplus
+#define NX_CONSTEXPR static constexpr inline
+#else
+#define NX_CONSTEXPR static inline
+#endif
@@ -160,6 +160,36 @@ void nvgCancelFrame(NVGcontext* ctx);
 // Ends drawing flushing remaining render state.
 void nvgEndFrame(NVGcontext* ctx);
 
+// Statistics of the last frame, as returned by nvgGetFrameStats().
+struct NVGframeStats {
+	// Counted by the front end since nvgBeginFrame().
+	int drawCallCount;
+	int fillTriCount;
+	int strokeTriCount;
+	int textTriCount;
+	// Reported by the render back-end for its last flush. Back-ends which do not track
+	// these leave them at zero.
+	int draws;					// Draw commands recorded.
+	int stateBinds;				// Render state changes recorded.
+	int stateBindsSkipped;		// Render state changes dropped for being redundant.
+	int cmdBytes;				// Command memory used, out of cmdCapacity bytes. May exceed it when more
+	int cmdCapacity;			// memory had to be chained on, capacity then grows for later frames.
+	int cmdPeakBytes;			// Most command memory used by any frame so far.
+	int vertexBytes;			// Vertex, index and uniform data uploaded for the frame.
+	int indexBytes;
+	int uniformBytes;
+	int textureUploadBytes;		// Texture data uploaded since the previous flush,
+	int textureUploadFailures;	// and texture updates left incomplete for lack of staging memory.
+	int descriptorAcquires;		// Image descriptors handed out to new textures since the previous flush,
+	int descriptorMisses;		// and textures which could not get one.
+	int droppedFrames;			// Frames dropped so far because their data could not be given memory.
+	float flushTime;			// CPU time spent flushing, in milliseconds.
+};
+typedef struct NVGframeStats NVGframeStats;
+
+// Fills stats with the figures of the last frame. Call after nvgEndFrame().
+void nvgGetFrameStats(NVGcontext* ctx, NVGframeStats* stats);
+
 //
 // Composite operation
 //
@@ -505,6 +535,13 @@ void nvgCircle(NVGcontext* ctx, float cx, float cy, float r);
 // Fills the current path with current fill style.
 void nvgFill(NVGcontext* ctx);
 
+// Fills the current path count times, as if each fill was preceded by nvgTransform() with the
+// matching six values of xforms, so the path and its paint are tessellated only once. When colors
+// is not NULL, each instance has its fill paint multiplied by its color, use a white fill color to
+// draw them in exactly their color. The anti-aliased edge is sized for the current transform,
+// instances are meant to be moved and rotated rather than scaled.
+void nvgFillInstances(NVGcontext* ctx, const float* xforms, const NVGcolor* colors, int count);
+
 // Fills the current path with current stroke style.
 void nvgStroke(NVGcontext* ctx);
 
@@ -654,12 +691,28 @@ struct NVGpath {
     int nstroke;
     int winding;
     int convex;
+    // Set by nvgStroke when the stroke of the path provably does not overlap itself.
+    int simpleStroke;
+    // Set by nvgFill when fill holds a triangle list of the path instead of its outline.
+    int triangulated;
 };
 typedef struct NVGpath NVGpath;
 
+struct NVGinstance {
+    float xform[6];		// Applied to the vertices, in view space.
+    NVGcolor color;		// Multiplies the colors of the paint.
+};
+typedef struct NVGinstance NVGinstance;
+
 struct NVGparams {
     void* userPtr;
     int edgeAntiAlias;
+    // Set when texture updates made during a frame are applied before any of its draws, so the
+    // font atlas only needs to be uploaded once, at the end of the frame.
+    int deferredTextureUpdates;
+    // Set when the back-end can draw paths whose fill is a triangle list, small concave fills are
+    // then triangulated on the CPU and drawn like convex ones, without the stencil.
+    int triangulateFills;
     int (*renderCreate)(void* uptr);
     int (*renderCreateTexture)(void* uptr, int type, int w, int h, int imageFlags, const unsigned char* data);
     int (*renderDeleteTexture)(void* uptr, int image);
@@ -671,7 +724,16 @@ struct NVGparams {
     void (*renderFill)(void* uptr, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor, float fringe, const float* bounds, const NVGpath* paths, int npaths);
     void (*renderStroke)(void* uptr, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor, float fringe, float strokeWidth, const NVGpath* paths, int npaths);
     void (*renderTriangles)(void* uptr, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor, const NVGvertex* verts, int nverts, float fringe);
+    // Optional, fills a rounded rectangle from its distance field instead of its outline. quad is a
+    // triangle fan covering the shape, with the position relative to its centre in u,v. shape holds
+    // the half width, half height and corner radius in those units, then the pixels per unit.
+    void (*renderShape)(void* uptr, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor, float fringe, const NVGvertex* quad, const float* shape);
+    // Optional, has the renderFill and renderShape calls that follow draw once per instance, their
+    // paint moving along with the vertices. Called again with no instances once they are done.
+    void (*renderInstances)(void* uptr, const NVGinstance* instances, int ninstances);
     void (*renderDelete)(void* uptr);
+    // Optional, fills in the back-end figures of NVGframeStats.
+    void (*renderGetStats)(void* uptr, NVGframeStats* stats);
 };
 typedef struct NVGparams NVGparams;
 
@@ -681,6 +743,9 @@ void nvgDeleteInternal(NVGcontext* ctx);
 
 NVGparams* nvgInternalParams(NVGcontext* ctx);
 
+// Returns the contents of the font atlas in use, and its image, for tools recording the render calls.
+const unsigned char* nvgInternalFontAtlas(NVGcontext* ctx, int* image, int* w, int* h);
+
 // Debug function to dump cached path data.
 void nvgDebugDumpPathCache(NVGcontext* ctx);
 
@@ -8,139 +8,145 @@
 
 #include "framework/CDescriptorSet.h"
 #include "framework/CMemPool.h"
-#include "framework/CShader.h"
+#include "framework/CShaderArchive.h"
 #include "framework/CCmdMemRing.h"
 #include "nanovg.h"
+#include "renderer.hpp"
 
-// Create flags
-enum NVGcreateFlags {
-    // Flag indicating if geometry based anti-aliasing is used (may not be needed when using MSAA).
-    NVG_ANTIALIAS 		= 1<<0,
-    // Flag indicating if strokes should be drawn using stencil buffer. The rendering will be a little
-    // slower, but path overlaps (i.e. self-intersecting or sharp turns) will be drawn just once.
-    NVG_STENCIL_STROKES	= 1<<1,
-    // Flag indicating that additional debug checks are done.
-    NVG_DEBUG 			= 1<<2,
-};
-
-enum DKNVGuniformLoc
-{
-    DKNVG_LOC_VIEWSIZE,
-    DKNVG_LOC_TEX,
-    DKNVG_LOC_FRAG,
-    DKNVG_MAX_LOCS
-};
-
-enum VKNVGshaderType {
-  NSVG_SHADER_FILLGRAD,
-  NSVG_SHADER_FILLIMG,
-  NSVG_SHADER_SIMPLE,
-  NSVG_SHADER_IMG
-};
-
-struct DKNVGtextureDescriptor {
-    int width, height;
-    int type;
-    int flags;
-};
-
-struct DKNVGblend {
-    int srcRGB;
-    int dstRGB;
-    int srcAlpha;
-    int dstAlpha;
-};
-
-enum DKNVGcallType {
-    DKNVG_NONE = 0,
-    DKNVG_FILL,
-    DKNVG_CONVEXFILL,
-    DKNVG_STROKE,
-    DKNVG_TRIANGLES,
-};
-
-struct DKNVGcall {
-    int type;
-    int image;
-    int pathOffset;
-    int pathCount;
-    int triangleOffset;
-    int triangleCount;
-    int uniformOffset;
-    DKNVGblend blendFunc;
-};
-
-struct DKNVGpath {
-    int fillOffset;
-    int fillCount;
-    int strokeOffset;
-    int strokeCount;
-};
-
-struct DKNVGfragUniforms {
-    float scissorMat[12]; // matrices are actually 3 vec4s
-    float paintMat[12];
-    struct NVGcolor innerCol;
-    struct NVGcolor outerCol;
-    float scissorExt[2];
-    float scissorScale[2];
-    float extent[2];
-    float radius;
-    float feather;
-    float strokeMult;
-    float strokeThr;
-    int texType;
-    int type;
-};
-
-namespace nvg {
-    class DkRenderer;
-}
-
-struct DKNVGcontext {
-    nvg::DkRenderer *renderer;
-    float view[2];
-    int fragSize;
-    int flags;
-    // Per frame buffers
-    DKNVGcall* calls;
-    int ccalls;
-    int ncalls;
-    DKNVGpath* paths;
-    int cpaths;
-    int npaths;
-    struct NVGvertex* verts;
-    int cverts;
-    int nverts;
-    unsigned char* uniforms;
-    int cuniforms;
-    int nuniforms;
-};
+// Number of frames the CPU may record ahead of the GPU. Each one gets its own slice of
+// command and vertex memory, guarded by its own fence.
+#ifndef DKNVG_FRAME_COUNT
+#define DKNVG_FRAME_COUNT 2
+#endif
 
 namespace nvg {
 
     class Texture {
         private:
             const int m_id;
+            const int m_descriptor_id;
             dk::Image m_image;
             dk::ImageDescriptor m_image_descriptor;
             CMemPool::Handle m_image_mem;
             DKNVGtextureDescriptor m_texture_descriptor;
         public:
-            Texture(int id);
+            Texture(int id, int descriptor_id);
             ~Texture();
 
-            void Initialize(CMemPool &image_pool, CMemPool &scratch_pool, dk::Device device, dk::Queue transfer_queue, int type, int w, int h, int image_flags, const u8 *data);
+            void Initialize(CMemPool &image_pool, dk::Device device, int type, int w, int h, int image_flags);
             void Update(CMemPool &image_pool, CMemPool &scratch_pool, dk::Device device, dk::Queue transfer_queue, int type, int w, int h, int image_flags, const u8 *data);
 
             int GetId();
+            int GetDescriptorId();
             const DKNVGtextureDescriptor &GetDescriptor();
 
             dk::Image &GetImage();
             dk::ImageDescriptor &GetImageDescriptor();
     };
 
-    class DkRenderer {
+    /* Shadows the GPU state set by the renderer so that redundant commands are never recorded. */
+    class StateTracker {
+        public:
+            struct Stats {
+                u32 emitted;
+                u32 skipped;
+            };
+        private:
+            enum StateBit : u32 {
+                StateBit_Blend         = 1 << 0,
+                StateBit_DepthStencil  = 1 << 1,
+                StateBit_ColorWrite    = 1 << 2,
+                StateBit_Rasterizer    = 1 << 3,
+                StateBit_StencilFront  = 1 << 4,
+                StateBit_StencilBack   = 1 << 5,
+                StateBit_FragUniforms  = 1 << 6,
+                StateBit_FragTexture   = 1 << 7,
+                StateBit_Scissor       = 1 << 8,
+                StateBit_FragShader    = 1 << 9,
+            };
+
+            struct StencilParams {
+                u8 mask;
+                u8 func_ref;
+                u8 func_mask;
+            };
+
+            dk::CmdBuf m_cmd_buf;
+            u32 m_valid = 0;
+            Stats m_stats = {};
+
+            DkBlendState m_blend_state;
+            DkDepthStencilState m_depth_stencil_state;
+            DkColorWriteState m_color_write_state;
+            DkRasterizerState m_rasterizer_state;
+            StencilParams m_stencil[2];
+            DkGpuAddr m_frag_uniform_addr;
+            DkResHandle m_frag_texture;
+            DkScissor m_scissor;
+            const DkShader *m_frag_shader;
+
+            template<typename T>
+            bool Update(StateBit bit, T &current, const T &value);
+        public:
+            void Begin(dk::CmdBuf cmd_buf);
+
+            void BindBlendState(const DkBlendState &state);
+            void BindDepthStencilState(const DkDepthStencilState &state);
+            void BindColorWriteState(const DkColorWriteState &state);
+            void BindRasterizerState(const DkRasterizerState &state);
+            void SetStencil(DkFace face, u8 mask, u8 func_ref, u8 func_mask);
+            void BindFragmentUniforms(DkGpuAddr addr, u32 size);
+            void BindFragmentTexture(DkResHandle handle);
+            void SetScissor(const DkScissor &scissor);
+            void BindFragmentShader(const DkShader *shader);
+
+            const DkScissor &GetScissor() const;
+            const Stats &GetStats() const;
+    };
+
+    /* Records texture copies from a persistent staging ring, to be submitted in batches ahead of the frame's draws. */
+    class UploadQueue {
+        public:
+            struct Stats {
+                u32 staged_bytes;
+                u32 copies;
+                u32 failed;
+            };
+        private:
+            static constexpr unsigned BatchCount = DKNVG_FRAME_COUNT;
+            static constexpr size_t BatchCmdSize = 0x4000;
+            static constexpr size_t BatchStagingSize = 0x80000;
+            /* Keeps the command memory of a batch from having to grow, each copy only takes a few words. */
+            static constexpr u32 MaxCopiesPerBatch = 0x40;
+
+            struct Copy {
+                dk::Image *image;
+                DkGpuAddr staging_addr;
+                u32 x, y, w, h;
+            };
+
+            dk::Queue m_queue;
+            dk::UniqueCmdBuf m_cmd_buf;
+            CCmdMemRing<BatchCount> m_cmd_mem;
+            std::vector<Copy> m_copies;
+            bool m_recording = false;
+            Stats m_stats = {};
+
+            CCmdMemRing<BatchCount>::DataHandle AllocateStaging(u32 size);
+        public:
+            bool Initialize(dk::Device device, dk::Queue queue, CMemPool &pool);
+
+            /* Data points to the top left pixel of the whole image, rows being pitch bytes apart. */
+            /* Returns false if staging memory ran out, rows queued before that are still copied. */
+            bool Upload(dk::Image &image, int type, int x, int y, int w, int h, const u8 *data, u32 pitch);
+            void Submit();
+
+            /* Counted from the last reset on, across however many batches were submitted in between. */
+            const Stats &GetStats() const;
+            void ResetStats();
+    };
+
+    class DkRenderer : public Renderer {
         private:
             enum SamplerType : u8 {
                 SamplerType_MipFilter = 1 << 0,
@@ -149,9 +155,21 @@ namespace nvg {
                 SamplerType_RepeatY   = 1 << 3,
                 SamplerType_Total     = 0x10,
             };
+
+            /* Fragment shader variants, indexed by the shader type of the fragment uniforms. */
+            enum FragmentShader : u8 {
+                FragmentShader_Gradient  = NSVG_SHADER_FILLGRAD,
+                FragmentShader_Image     = NSVG_SHADER_FILLIMG,
+                FragmentShader_Stencil   = NSVG_SHADER_SIMPLE,
+                FragmentShader_Triangles = NSVG_SHADER_IMG,
+                FragmentShader_Shape     = NSVG_SHADER_FILLSHAPE,
+                FragmentShader_Total,
+            };
         private:
+            static constexpr unsigned FrameCount = DKNVG_FRAME_COUNT;
+            /* Initial per-frame command memory. Frames that need more chain it on, and the ring grows to fit them from then on. */
             static constexpr size_t DynamicCmdSize = 0x20000;
-            static constexpr size_t FragmentUniformSize = sizeof(DKNVGfragUniforms) + 4 - sizeof(DKNVGfragUniforms) % 4;
+            static constexpr size_t DynamicDataSize = 0x40000;
             static constexpr size_t MaxImages = 0x1000;
 
             /* From the application. */
@@ -165,44 +183,90 @@ namespace nvg {
 
             /* State. */
             dk::UniqueCmdBuf m_dyn_cmd_buf;
-            CCmdMemRing<1> m_dyn_cmd_mem;
-            std::optional<CMemPool::Handle> m_vertex_buffer;
-            CShader m_vertex_shader;
-            CShader m_fragment_shader;
-            CMemPool::Handle m_view_uniform_buffer;
-            CMemPool::Handle m_frag_uniform_buffer;
-
-            u32 m_next_texture_id = 1;
-            std::vector<std::shared_ptr<Texture>> m_textures;
+            CCmdMemRing<FrameCount> m_dyn_cmd_mem;
+            /* Every shader variant comes out of one archive, its code loaded with a single read. */
+            CShaderArchive m_shader_archive;
+            const dk::Shader *m_vertex_shader = nullptr;
+            /* Fragment shaders specialized for each kind of paint, picked from the uniforms of every draw. */
+            const dk::Shader *m_fragment_shaders[FragmentShader_Total] = {};
+            DkGpuAddr m_frag_uniform_addr = DK_GPU_ADDR_INVALID;
+            StateTracker m_state;
+            UploadQueue m_uploads;
+
+            /* Texture ids are generational handles: the low bits select a slot and the high bits reject stale ids. */
+            static constexpr int TextureSlotBits = 16;
+            static constexpr int TextureSlotMask = (1 << TextureSlotBits) - 1;
+            static constexpr int MaxTextureGeneration = 0x7FFF;
+
+            struct TextureSlot {
+                std::unique_ptr<Texture> texture;
+                int generation;
+            };
+
+            std::vector<TextureSlot> m_texture_slots;
+            std::vector<int> m_free_texture_slots;
             CDescriptorSet<MaxImages> m_image_descriptor_set;
             CDescriptorSet<SamplerType_Total> m_sampler_descriptor_set;
-            std::array<int, MaxImages> m_image_descriptor_mappings;
-            int m_last_image_descriptor = 0;
+            /* Descriptors written since the last flush, by texture id. */
+            std::vector<int> m_pending_descriptors;
+
+            /* Deleted textures stay alive until the GPU is done with the last frame which could have used them. */
+            struct RetiredTexture {
+                std::unique_ptr<Texture> texture;
+                u64 last_frame;
+            };
+
+            std::vector<RetiredTexture> m_retired_textures;
+            u64 m_frame_index = 0;
+            u32 m_dropped_frames = 0;
 
-            int AcquireImageDescriptor(std::shared_ptr<Texture> texture, int image);
-            void FreeImageDescriptor(int image);
+            /* Value the last stencil stroke marked its pixels with. The marks are left behind and only cleared once the values wrap. */
+            u8 m_stroke_stencil_ref = 0;
+
+            /* Back-end figures of the frame being recorded, and of the last one flushed. */
+            NVGframeStats m_stats = {};
+            NVGframeStats m_last_stats = {};
+
+            void UpdateImageDescriptors();
+            void ReleaseRetiredTextures(u64 completed_frames);
             void SetUniforms(const DKNVGcontext &ctx, int offset, int image);
 
-            void UpdateVertexBuffer(const void *data, size_t size);
+            bool UpdateVertexBuffer(const void *data, size_t size);
+            bool UpdateInstanceBuffer(const DKNVGcontext &ctx);
+            bool UpdateViewUniforms();
+            bool UpdateFragmentUniforms(const void *data, size_t size);
+            bool UpdateIndexBuffer(const DKNVGcontext &ctx, int count);
+
+            DkScissor GetScissorRect(const DKNVGcontext &ctx, const DKNVGcall &call) const;
+            void ClipFillQuads(DKNVGcontext &ctx);
 
+            void Draw(DkPrimitive primitive, u32 vertex_count, u32 first_vertex, u32 instance_count = 1, u32 first_instance = 0);
+            void DrawIndexed(u32 index_count, u32 first_index, u32 instance_count = 1, u32 first_instance = 0);
+
+            u8 NextStrokeStencilRef();
             void DrawFill(const DKNVGcontext &ctx, const DKNVGcall &call);
+            void DrawFillInstance(const DKNVGcontext &ctx, const DKNVGcall &call, u32 instance);
             void DrawConvexFill(const DKNVGcontext &ctx, const DKNVGcall &call);
             void DrawStroke(const DKNVGcontext &ctx, const DKNVGcall &call);
             void DrawTriangles(const DKNVGcontext &ctx, const DKNVGcall &call);
+            void BindDefaultStates();
 
-            std::shared_ptr<Texture> FindTexture(int id);
+            Texture *FindTexture(int id);
         public:
             DkRenderer(unsigned int view_width, unsigned int view_height, dk::Device device, dk::Queue queue, CMemPool &image_mem_pool, CMemPool &code_mem_pool, CMemPool &data_mem_pool);
-            ~DkRenderer();
+            ~DkRenderer() override;
+
+            int Create(DKNVGcontext &ctx) override;
+            int CreateTexture(const DKNVGcontext &ctx, int type, int w, int h, int image_flags, const u8 *data) override;
+            int DeleteTexture(const DKNVGcontext &ctx, int id) override;
+            int UpdateTexture(const DKNVGcontext &ctx, int id, int x, int y, int w, int h, const u8 *data) override;
+            int GetTextureSize(const DKNVGcontext &ctx, int id, int *w, int *h) override;
+            const DKNVGtextureDescriptor *GetTextureDescriptor(const DKNVGcontext &ctx, int id) override;
 
-            int Create(DKNVGcontext &ctx);
-            int CreateTexture(const DKNVGcontext &ctx, int type, int w, int h, int image_flags, const u8 *data);
-            int DeleteTexture(const DKNVGcontext &ctx, int id);
-            int UpdateTexture(const DKNVGcontext &ctx, int id, int x, int y, int w, int h, const u8 *data);
-            int GetTextureSize(const DKNVGcontext &ctx, int id, int *w, int *h);
-            const DKNVGtextureDescriptor *GetTextureDescriptor(const DKNVGcontext &ctx, int id);
+            void Flush(DKNVGcontext &ctx) override;
+            void GetFrameStats(NVGframeStats &stats) const override;
 
-            void Flush(DKNVGcontext &ctx);
+            const StateTracker::Stats &GetStateStats() const;
     };
 
 }
\ No newline at end of file
@@ -333,6 +333,10 @@ int fons__tt_getGlyphKernAdvance(FONSttFontImpl *font, int glyph1, int glyph2)
 #ifndef FONS_SCRATCH_BUF_SIZE
 #	define FONS_SCRATCH_BUF_SIZE 96000
 #endif
+// Times the enclosing scope when defined, for profiling glyph rasterization.
+#ifndef FONS_TRACE_ZONE
+#	define FONS_TRACE_ZONE(name)
+#endif
 #ifndef FONS_HASH_LUT_SIZE
 #	define FONS_HASH_LUT_SIZE 256
 #endif
@@ -1101,6 +1105,9 @@ static FONSglyph* fons__getGlyph(FONScontext* stash, FONSfont* font, unsigned in
         i = font->glyphs[i].next;
     }
 
+    // Cache hits are too frequent and short to be worth a zone, only time the misses.
+    FONS_TRACE_ZONE("fons__getGlyph");
+
     // Create a new glyph or rasterize bitmap data for a cached glyph.
     g = fons__tt_getGlyphIndex(&font->font, codepoint);
     // Try to find the glyph in fallback fonts.
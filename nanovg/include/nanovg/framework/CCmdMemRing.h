@@ -6,25 +6,209 @@
 #include "common.h"
 #include "CMemPool.h"
 
+#include <vector>
+
 template <unsigned NumSlices>
 class CCmdMemRing
 {
     static_assert(NumSlices > 0, "Need a non-zero number of slices...");
+    static constexpr uint32_t DataAlignment = DK_UNIFORM_BUF_ALIGNMENT;
+
+    // deko3d can't tell how much of the memory given to a command buffer was used, so marker
+    // words are planted across the command memory of a slice when it is begun. Commands are
+    // written from the start of it, the first marker left intact bounds their size.
+    static constexpr uint32_t CmdProbeStride = 0x200;
+    static constexpr uint32_t CmdProbeValue = 0xBAADF00D;
+
+    CMemPool* m_pool;
     CMemPool::Handle m_mem;
     unsigned m_curSlice;
+    uint32_t m_cmdSize;
+    uint32_t m_cmdUsed;
+    uint32_t m_cmdPeak;
+    uint32_t m_cmdGrowFailed;
+    uint32_t m_dataSize;
+    uint32_t m_dataUsed;
+    uint32_t m_dataPeak;
     dk::Fence m_fences[NumSlices];
+
+    // Memory chained onto a slice after its command memory ran out, freed once the slice is reused
+    std::vector<CMemPool::Handle> m_chunks[NumSlices];
+
+    constexpr uint32_t getSliceSize() const
+    {
+        return m_cmdSize + m_dataSize;
+    }
+
+    static void plantProbes(void* cpuAddr, uint32_t size)
+    {
+        volatile uint32_t* probes = (volatile uint32_t*)cpuAddr;
+        for (uint32_t offset = 0; offset < size; offset += CmdProbeStride)
+            probes[offset / sizeof(uint32_t)] = CmdProbeValue;
+    }
+
+    static uint32_t measureProbes(const void* cpuAddr, uint32_t size)
+    {
+        const volatile uint32_t* probes = (const volatile uint32_t*)cpuAddr;
+        uint32_t used;
+        for (used = 0; used < size; used += CmdProbeStride)
+            if (probes[used / sizeof(uint32_t)] == CmdProbeValue)
+                break;
+        return used < size ? used : size;
+    }
+
+    void releaseChunks(unsigned slice)
+    {
+        for (CMemPool::Handle& chunk : m_chunks[slice])
+            chunk.destroy();
+        m_chunks[slice].clear();
+    }
+
+    void addChunk(DkCmdBuf cmdbuf, size_t minReqSize)
+    {
+        if (!m_pool)
+            return;
+
+        // Chain at least as much as the slice itself, so a busy frame doesn't need many chunks
+        uint32_t size = minReqSize > m_cmdSize ? minReqSize : m_cmdSize;
+        size = (size + DK_CMDMEM_ALIGNMENT - 1) &~ (DK_CMDMEM_ALIGNMENT - 1);
+
+        CMemPool::Handle chunk = m_pool->allocate(size, DK_CMDMEM_ALIGNMENT);
+        if (!chunk)
+        {
+            // deko3d aborts on the overflow that follows, leave a hint of why
+            printf("CCmdMemRing: failed to chain 0x%x bytes of command memory\n", size);
+            return;
+        }
+
+        plantProbes(chunk.getCpuAddr(), chunk.getSize());
+        dkCmdBufAddMemory(cmdbuf, chunk.getMemBlock(), chunk.getOffset(), chunk.getSize());
+        m_chunks[m_curSlice].push_back(chunk);
+    }
+
+    static void onOutOfMemory(void* userData, DkCmdBuf cmdbuf, size_t minReqSize)
+    {
+        static_cast<CCmdMemRing*>(userData)->addChunk(cmdbuf, minReqSize);
+    }
+
+    void waitAll()
+    {
+        for (unsigned i = 0; i < NumSlices; i++)
+        {
+            m_fences[i].wait();
+            releaseChunks(i);
+        }
+    }
+
+    bool resize(uint32_t sliceSize, uint32_t dataSize)
+    {
+        // Each slice holds the command memory followed by an optional data area, which
+        // needs to start on a boundary suitable for any kind of GPU buffer
+        uint32_t cmdSize = (sliceSize + DK_CMDMEM_ALIGNMENT - 1) &~ (DK_CMDMEM_ALIGNMENT - 1);
+        dataSize = (dataSize + DataAlignment - 1) &~ (DataAlignment - 1);
+        if (dataSize)
+            cmdSize = (cmdSize + DataAlignment - 1) &~ (DataAlignment - 1);
+
+        // The new block is allocated before the current one is let go of, so that a failure
+        // leaves the ring with the memory it already had
+        CMemPool::Handle mem = m_pool->allocate(NumSlices*(cmdSize + dataSize), dataSize ? DataAlignment : DK_CMDMEM_ALIGNMENT);
+        if (!mem)
+            return false;
+
+        // Every slice is about to move, so none of them may still be in use by the GPU
+        waitAll();
+
+        m_mem.destroy();
+        m_mem = mem;
+        m_cmdSize = cmdSize;
+        m_dataSize = dataSize;
+        return true;
+    }
+
 public:
-    CCmdMemRing() : m_mem{}, m_curSlice{}, m_fences{} { }
+    // Linear allocation out of the data area of the slice currently being recorded.
+    // It stays valid until the fence of that slice has been waited on again.
+    class DataHandle
+    {
+        void* m_cpuAddr;
+        DkGpuAddr m_gpuAddr;
+        uint32_t m_size;
+    public:
+        constexpr DataHandle() : m_cpuAddr{}, m_gpuAddr{DK_GPU_ADDR_INVALID}, m_size{} { }
+        constexpr DataHandle(void* cpuAddr, DkGpuAddr gpuAddr, uint32_t size) : m_cpuAddr{cpuAddr}, m_gpuAddr{gpuAddr}, m_size{size} { }
+        constexpr operator bool() const { return m_cpuAddr != nullptr; }
+
+        constexpr void* getCpuAddr() const { return m_cpuAddr; }
+        constexpr DkGpuAddr getGpuAddr() const { return m_gpuAddr; }
+        constexpr uint32_t getSize() const { return m_size; }
+    };
+
+    CCmdMemRing() : m_pool{}, m_mem{}, m_curSlice{}, m_cmdSize{}, m_cmdUsed{}, m_cmdPeak{}, m_cmdGrowFailed{}, m_dataSize{}, m_dataUsed{}, m_dataPeak{}, m_fences{}, m_chunks{} { }
     ~CCmdMemRing()
     {
+        for (unsigned i = 0; i < NumSlices; i++)
+            releaseChunks(i);
         m_mem.destroy();
     }
 
-    bool allocate(CMemPool& pool, uint32_t sliceSize)
+    // Command buffers created through here chain more memory from the pool when a slice runs
+    // out, instead of failing. The ring must outlive them and stay at the same address.
+    dk::UniqueCmdBuf createCmdBuf(dk::Device device)
+    {
+        return dk::CmdBufMaker{device}.setUserData(this).setCbMemory(onOutOfMemory).create();
+    }
+
+    bool allocate(CMemPool& pool, uint32_t sliceSize, uint32_t dataSize = 0)
+    {
+        m_pool = &pool;
+        return resize(sliceSize, dataSize);
+    }
+
+    bool reserveData(CMemPool& pool, uint32_t dataSize)
     {
-        sliceSize = (sliceSize + DK_CMDMEM_ALIGNMENT - 1) &~ (DK_CMDMEM_ALIGNMENT - 1);
-        m_mem = pool.allocate(NumSlices*sliceSize);
-        return m_mem;
+        if (dataSize <= m_dataSize)
+            return true;
+
+        uint32_t newSize = m_dataSize ? m_dataSize : DataAlignment;
+        while (newSize < dataSize)
+            newSize *= 2;
+
+        m_pool = &pool;
+        return resize(m_cmdSize, newSize);
+    }
+
+    constexpr uint32_t getDataSize() const
+    {
+        return m_dataSize;
+    }
+
+    constexpr uint32_t getCmdSize() const
+    {
+        return m_cmdSize;
+    }
+
+    // Command memory used by the last finished list, chained memory included, rounded up to the
+    // probe stride.
+    constexpr uint32_t getCmdUsed() const
+    {
+        return m_cmdUsed;
+    }
+
+    // Data memory handed out for the slice currently being recorded.
+    constexpr uint32_t getDataUsed() const
+    {
+        return m_dataUsed;
+    }
+
+    // High-water marks over every list finished so far.
+    constexpr uint32_t getCmdPeak() const
+    {
+        return m_cmdPeak;
+    }
+
+    constexpr uint32_t getDataPeak() const
+    {
+        return m_dataPeak;
     }
 
     void begin(dk::CmdBuf cmdbuf)
@@ -33,12 +217,47 @@ public:
         // (but remember: it does *not* in fact destroy the command data)
         cmdbuf.clear();
 
-        // Wait for the current slice of memory to be available, and feed it to the command buffer
-        uint32_t sliceSize = m_mem.getSize() / NumSlices;
+        // If a list ever needed chained memory, grow the slices to fit the busiest one seen, so
+        // that steady-state frames are recorded into a single block again
+        if (m_cmdPeak > m_cmdSize && m_pool)
+        {
+            uint32_t newSize = m_cmdSize;
+            while (newSize < m_cmdPeak)
+                newSize *= 2;
+
+            // Should the pool be out of memory, the current slices carry on with chaining, and
+            // growing to this size or beyond isn't attempted again every frame
+            if (!m_cmdGrowFailed || newSize < m_cmdGrowFailed)
+            {
+                if (!resize(newSize, m_dataSize))
+                    m_cmdGrowFailed = newSize;
+            }
+        }
+
+        // Wait for the current slice of memory to be available, along with whatever was chained onto it
+        uint32_t sliceSize = getSliceSize();
         m_fences[m_curSlice].wait();
+        releaseChunks(m_curSlice);
+
+        // Plant the markers measuring how much of it gets used
+        plantProbes((u8*)m_mem.getCpuAddr() + m_curSlice * sliceSize, m_cmdSize);
 
         // Feed the memory to the command buffer
-        cmdbuf.addMemory(m_mem.getMemBlock(), m_mem.getOffset() + m_curSlice * sliceSize, sliceSize);
+        cmdbuf.addMemory(m_mem.getMemBlock(), m_mem.getOffset() + m_curSlice * sliceSize, m_cmdSize);
+
+        // The data area of this slice is now free to be handed out again
+        m_dataUsed = 0;
+    }
+
+    DataHandle allocateData(uint32_t size, uint32_t alignment = DataAlignment)
+    {
+        uint32_t offset = (m_dataUsed + alignment - 1) &~ (alignment - 1);
+        if (!size || offset + size > m_dataSize)
+            return DataHandle{};
+
+        m_dataUsed = offset + size;
+        offset += m_curSlice * getSliceSize() + m_cmdSize;
+        return DataHandle{(u8*)m_mem.getCpuAddr() + offset, m_mem.getGpuAddr() + offset, size};
     }
 
     DkCmdList end(dk::CmdBuf cmdbuf)
@@ -48,10 +267,29 @@ public:
         // (and as such we don't overwrite in-flight command data with new one)
         cmdbuf.signalFence(m_fences[m_curSlice]);
 
+        // Finish off the command list, then see how much memory its commands took. Memory which
+        // was chained on is used up to the last chunk, the slice itself counting in full.
+        DkCmdList list = cmdbuf.finishList();
+        const std::vector<CMemPool::Handle>& chunks = m_chunks[m_curSlice];
+        if (chunks.empty())
+            m_cmdUsed = measureProbes((u8*)m_mem.getCpuAddr() + m_curSlice * getSliceSize(), m_cmdSize);
+        else
+        {
+            m_cmdUsed = m_cmdSize;
+            for (size_t i = 0; i + 1 < chunks.size(); i++)
+                m_cmdUsed += chunks[i].getSize();
+            m_cmdUsed += measureProbes(chunks.back().getCpuAddr(), chunks.back().getSize());
+        }
+
+        if (m_cmdUsed > m_cmdPeak)
+            m_cmdPeak = m_cmdUsed;
+        if (m_dataUsed > m_dataPeak)
+            m_dataPeak = m_dataUsed;
+
         // Advance the current slice counter; wrapping around when we reach the end
         m_curSlice = (m_curSlice + 1) % NumSlices;
 
-        // Finish off the command list, returning it to the caller
-        return cmdbuf.finishList();
+        // Return the command list to the caller
+        return list;
     }
 };
@@ -6,6 +6,9 @@
 #include "common.h"
 #include "CMemPool.h"
 
+#include <algorithm>
+#include <assert.h>
+
 template <unsigned NumDescriptors>
 class CDescriptorSet
 {
@@ -16,8 +19,15 @@ class CDescriptorSet
     static constexpr size_t DescriptorAlign = DK_IMAGE_DESCRIPTOR_ALIGNMENT;
 
     CMemPool::Handle m_mem;
+    uint32_t m_freeIds[NumDescriptors];
+    uint32_t m_numFree;
 public:
-    CDescriptorSet() : m_mem{} { }
+    CDescriptorSet() : m_mem{}, m_numFree{NumDescriptors}
+    {
+        // Stack of unused ids, ordered so that the lowest ones are handed out first
+        for (uint32_t i = 0; i < NumDescriptors; i++)
+            m_freeIds[i] = NumDescriptors - 1 - i;
+    }
     ~CDescriptorSet()
     {
         m_mem.destroy();
@@ -29,6 +39,19 @@ public:
         return m_mem;
     }
 
+    int allocateId()
+    {
+        return m_numFree ? static_cast<int>(m_freeIds[--m_numFree]) : -1;
+    }
+
+    void freeId(uint32_t id)
+    {
+        // A bad or repeated id would later be handed out to two users at once
+        assert(id < NumDescriptors && m_numFree < NumDescriptors);
+        assert(std::find(m_freeIds, m_freeIds + m_numFree, id) == m_freeIds + m_numFree);
+        m_freeIds[m_numFree++] = id;
+    }
+
     void bindForImages(dk::CmdBuf cmdbuf)
     {
         cmdbuf.bindImageDescriptorSet(m_mem.getGpuAddr(), NumDescriptors);
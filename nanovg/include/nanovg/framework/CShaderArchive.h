@@ -0,0 +1,39 @@
+/*
+** Sample Framework for deko3d Applications
+**   CShaderArchive.h: Utility class for loading a packed set of shaders from the filesystem
+*/
+#pragma once
+#include "common.h"
+#include "CMemPool.h"
+#include "DkshArchive.h"
+
+#include <vector>
+
+class CShaderArchive
+{
+    struct Entry
+    {
+        char name[DKSH_ARCHIVE_NAME_LEN];
+        dk::Shader shader;
+    };
+
+    std::vector<Entry> m_shaders;
+    CMemPool::Handle m_codemem;
+public:
+    CShaderArchive() : m_shaders{}, m_codemem{} { }
+    ~CShaderArchive()
+    {
+        m_codemem.destroy();
+    }
+
+    constexpr operator bool() const
+    {
+        return m_codemem;
+    }
+
+    // Reads the whole archive in one go, its code going straight into a single allocation from the pool.
+    bool load(CMemPool& pool, const char* path);
+
+    // Looks up a shader by its file name without extension, e.g. "fill_vsh". Returns nullptr if missing.
+    const dk::Shader* find(const char* name) const;
+};
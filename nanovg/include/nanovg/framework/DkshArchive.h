@@ -0,0 +1,44 @@
+/*
+** Sample Framework for deko3d Applications
+**   DkshArchive.h: Layout of compiled shader files, and of the archives packing several of them
+*/
+#pragma once
+#include <stdint.h>
+
+// Kept free of deko3d so that the host side packer can share it.
+#ifndef DKSH_MAGIC
+#define DKSH_MAGIC 0x48534B44 // "DKSH"
+#endif
+#define DKSH_ARCHIVE_MAGIC 0x41534B44 // "DKSA"
+#define DKSH_ARCHIVE_NAME_LEN 32
+#define DKSH_ARCHIVE_CODE_ALIGNMENT 0x100 // Same as DK_SHADER_CODE_ALIGNMENT
+
+typedef struct DkshHeader
+{
+    uint32_t magic; // DKSH_MAGIC
+    uint32_t header_sz; // sizeof(DkshHeader)
+    uint32_t control_sz;
+    uint32_t code_sz;
+    uint32_t programs_off;
+    uint32_t num_programs;
+} DkshHeader;
+
+// An archive starts with this header and the entries of every shader, followed by their control
+// sections. The code of all shaders comes last, starting at code_off, so that it can be read straight
+// into code memory. Each shader's code is aligned to DKSH_ARCHIVE_CODE_ALIGNMENT within it.
+typedef struct DkshArchiveHeader
+{
+    uint32_t magic; // DKSH_ARCHIVE_MAGIC
+    uint32_t num_shaders;
+    uint32_t code_off;
+    uint32_t code_sz;
+} DkshArchiveHeader;
+
+typedef struct DkshArchiveEntry
+{
+    char name[DKSH_ARCHIVE_NAME_LEN]; // File name of the shader without its extension, NUL terminated
+    uint32_t control_off; // From the start of the archive
+    uint32_t control_sz;
+    uint32_t code_off; // From the start of the code
+    uint32_t code_sz;
+} DkshArchiveEntry;
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "nanovg.h"
+#include "renderer.hpp"
+
+namespace nvg {
+
+    /* Renderer keeping everything in host memory, so that the front end can run without a GPU. */
+    class NullRenderer : public Renderer {
+        protected:
+            struct Texture {
+                DKNVGtextureDescriptor descriptor;
+                std::vector<uint8_t> data;
+            };
+
+            Texture *FindTexture(int id);
+        private:
+            std::vector<std::unique_ptr<Texture>> m_textures;
+            std::vector<int> m_free_textures;
+
+            /* Contents of the last flush, as they would have been uploaded to the GPU. */
+            std::vector<DKNVGcall> m_calls;
+            std::vector<NVGvertex> m_vertices;
+            std::vector<uint32_t> m_indices;
+            std::vector<uint8_t> m_uniforms;
+            std::vector<DKNVGinstance> m_instances;
+        public:
+            int Create(DKNVGcontext &ctx) override;
+            int CreateTexture(const DKNVGcontext &ctx, int type, int w, int h, int image_flags, const uint8_t *data) override;
+            int DeleteTexture(const DKNVGcontext &ctx, int id) override;
+            int UpdateTexture(const DKNVGcontext &ctx, int id, int x, int y, int w, int h, const uint8_t *data) override;
+            int GetTextureSize(const DKNVGcontext &ctx, int id, int *w, int *h) override;
+            const DKNVGtextureDescriptor *GetTextureDescriptor(const DKNVGcontext &ctx, int id) override;
+
+            void Flush(DKNVGcontext &ctx) override;
+
+            const std::vector<DKNVGcall> &GetCalls() const;
+            const std::vector<NVGvertex> &GetVertices() const;
+            const std::vector<uint32_t> &GetIndices() const;
+            const std::vector<uint8_t> &GetUniforms() const;
+            const std::vector<DKNVGinstance> &GetInstances() const;
+            const std::vector<uint8_t> *GetTextureData(int id);
+    };
+
+}
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nanovg.h"
+
+// Alignment of each fragment uniform block, host builds without deko3d lay them out the same way.
+#ifdef DK_UNIFORM_BUF_ALIGNMENT
+#define DKNVG_UNIFORM_ALIGNMENT DK_UNIFORM_BUF_ALIGNMENT
+#else
+#define DKNVG_UNIFORM_ALIGNMENT 0x100 // Same as DK_UNIFORM_BUF_ALIGNMENT
+#endif
+
+// Number of stencil bits given to stencil strokes, the others count fill windings. Strokes take turns
+// marking their pixels with one of the 2^bits-1 values these allow, the stroke bits being cleared each
+// time they run out. Nonzero fills wrap around at 2^(8-bits) windings in the same direction.
+#ifndef DKNVG_STROKE_STENCIL_BITS
+#define DKNVG_STROKE_STENCIL_BITS 2
+#endif
+
+// Create flags
+enum NVGcreateFlags {
+    // Flag indicating if geometry based anti-aliasing is used (may not be needed when using MSAA).
+    NVG_ANTIALIAS 		= 1<<0,
+    // Flag indicating if strokes should be drawn using stencil buffer. The rendering will be a little
+    // slower, but path overlaps (i.e. self-intersecting or sharp turns) will be drawn just once.
+    NVG_STENCIL_STROKES	= 1<<1,
+    // Flag indicating that additional debug checks are done.
+    NVG_DEBUG 			= 1<<2,
+};
+
+enum DKNVGuniformLoc
+{
+    DKNVG_LOC_VIEWSIZE,
+    DKNVG_LOC_TEX,
+    DKNVG_LOC_FRAG,
+    DKNVG_MAX_LOCS
+};
+
+enum VKNVGshaderType {
+  NSVG_SHADER_FILLGRAD,
+  NSVG_SHADER_FILLIMG,
+  NSVG_SHADER_SIMPLE,
+  NSVG_SHADER_IMG,
+  NSVG_SHADER_FILLSHAPE
+};
+
+struct DKNVGtextureDescriptor {
+    int width, height;
+    int type;
+    int flags;
+};
+
+// Blend factors are kept as NVGblendFactor values, back-ends convert them to their own.
+struct DKNVGblend {
+    int srcRGB;
+    int dstRGB;
+    int srcAlpha;
+    int dstAlpha;
+};
+
+enum DKNVGcallType {
+    DKNVG_NONE = 0,
+    DKNVG_FILL,
+    DKNVG_CONVEXFILL,
+    DKNVG_STROKE,
+    DKNVG_TRIANGLES,
+};
+
+struct DKNVGcall {
+    int type;
+    int image;
+    int pathOffset;
+    int pathCount;
+    int triangleOffset;
+    int triangleCount;
+    int indexOffset;
+    int indexCount;
+    int fringeIndexOffset;
+    int fringeIndexCount;
+    int uniformOffset;
+    DKNVGblend blendFunc;
+    // Area the scissor lets the call draw to, as x0, y0, x1, y1 in view coordinates. Back-ends may clip to it.
+    float scissorBounds[4];
+    // Set on strokes which can't overlap themselves, these are drawn in a single pass even with stencil strokes.
+    int simpleStroke;
+    // Fills drawn once per instance, see NVGparams::renderInstances. The count is 0 for the others.
+    int instanceOffset;
+    int instanceCount;
+};
+
+struct DKNVGpath {
+    int fillOffset;
+    int fillCount;
+    int strokeOffset;
+    int strokeCount;
+    // Set when the fill is a triangle list rather than a fan, see NVGpath::triangulated.
+    int triangulated;
+};
+
+struct DKNVGfragUniforms {
+    float scissorMat[12]; // matrices are actually 3 vec4s
+    float paintMat[12];
+    struct NVGcolor innerCol;
+    struct NVGcolor outerCol;
+    float scissorExt[2];
+    float scissorScale[2];
+    float extent[2];
+    float radius;
+    float feather;
+    float strokeMult;
+    float strokeThr;
+    int texType;
+    int type;
+    // Shape filled from its distance field, see NVGparams::renderShape.
+    float shapeExt[2];
+    float shapeRadius;
+    float shapeScale;
+};
+
+// Per instance vertex attributes, the transform being applied to the vertices and the color multiplying the paint.
+struct DKNVGinstance {
+    float xform[6];
+    struct NVGcolor tint; // Premultiplied
+};
+
+namespace nvg {
+    class Renderer;
+}
+
+struct DKNVGcontext {
+    nvg::Renderer *renderer;
+    float view[2];
+    int fragSize;
+    int flags;
+    // Per frame buffers
+    DKNVGcall* calls;
+    int ccalls;
+    int ncalls;
+    DKNVGpath* paths;
+    int cpaths;
+    int npaths;
+    struct NVGvertex* verts;
+    int cverts;
+    int nverts;
+    unsigned char* uniforms;
+    int cuniforms;
+    int nuniforms;
+    DKNVGinstance* instances;
+    int cinstances;
+    int ninstances;
+    // Instances the fills being recorded are drawn with, the offset is -1 if they could not be allocated.
+    int instanceOffset;
+    int instanceCount;
+};
+
+namespace nvg {
+
+    /* Consumes the calls recorded by the front end, independently of the graphics API behind it. */
+    class Renderer {
+        public:
+            /* Fragment uniforms are uploaded in bulk, so each block is padded out to the uniform buffer alignment. */
+            static constexpr size_t FragmentUniformSize = (sizeof(DKNVGfragUniforms) + DKNVG_UNIFORM_ALIGNMENT - 1) &~ (DKNVG_UNIFORM_ALIGNMENT - 1);
+        protected:
+            static_assert(DKNVG_STROKE_STENCIL_BITS >= 1 && DKNVG_STROKE_STENCIL_BITS <= 7, "Fills and stencil strokes both need stencil bits");
+
+            /* The stencil is split between fills, counting windings in the low bits, and stencil strokes in the high bits. */
+            static constexpr int StrokeStencilShift = 8 - DKNVG_STROKE_STENCIL_BITS;
+            static constexpr uint8_t FillStencilMask = (1 << StrokeStencilShift) - 1;
+            static constexpr uint8_t StrokeStencilMask = 0xFF & ~FillStencilMask;
+            static constexpr uint8_t MaxStrokeStencilRef = StrokeStencilMask >> StrokeStencilShift;
+
+            /* Coalesces compatible calls and lays out their index ranges, returning the number of indices needed. */
+            static int MergeCalls(DKNVGcontext &ctx);
+
+            /* Writes the triangle list indices of every call, as laid out by MergeCalls. */
+            static void WriteIndices(const DKNVGcontext &ctx, uint16_t *indices);
+            static void WriteIndices(const DKNVGcontext &ctx, uint32_t *indices);
+        public:
+            virtual ~Renderer() = default;
+
+            virtual int Create(DKNVGcontext &ctx) = 0;
+            virtual int CreateTexture(const DKNVGcontext &ctx, int type, int w, int h, int image_flags, const uint8_t *data) = 0;
+            virtual int DeleteTexture(const DKNVGcontext &ctx, int id) = 0;
+            virtual int UpdateTexture(const DKNVGcontext &ctx, int id, int x, int y, int w, int h, const uint8_t *data) = 0;
+            virtual int GetTextureSize(const DKNVGcontext &ctx, int id, int *w, int *h) = 0;
+            virtual const DKNVGtextureDescriptor *GetTextureDescriptor(const DKNVGcontext &ctx, int id) = 0;
+
+            virtual void Flush(DKNVGcontext &ctx) = 0;
+
+            /* Fills in the back-end figures of the last flush, the front-end ones are left untouched. */
+            virtual void GetFrameStats(NVGframeStats &stats) const { /* ... */ }
+    };
+
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vector>
+
+#include "nanovg.h"
+#include "null_renderer.hpp"
+
+namespace nvg {
+
+    /* Reference renderer rasterizing each flushed frame into a host RGBA buffer, following the same passes as DkRenderer. */
+    class SwRenderer : public NullRenderer {
+        private:
+            static constexpr int TileSize = 64;
+
+            /* Stencil and colour setup of each pass, as bound by the DkRenderer draw functions. */
+            enum PassType : uint8_t {
+                PassType_Plain,
+                PassType_FillStencil,
+                PassType_FillFringe,
+                PassType_FillCover,
+                PassType_StrokeBase,
+                PassType_StrokeFringe,
+                PassType_StrokeWrap,
+            };
+
+            struct Pass {
+                PassType type;
+                /* Value stencil strokes mark their pixels with. */
+                uint8_t stencil_ref;
+                const Texture *texture;
+                DKNVGblend blend;
+                const DKNVGfragUniforms *uniforms;
+                int index_offset;
+                int index_count;
+                /* Transform and tint of the instance drawn, nullptr for calls which aren't instanced. */
+                const DKNVGinstance *instance;
+            };
+
+            struct Vertex {
+                double x, y;
+                float u, v;
+                float px, py;
+                /* Position before the instance transform, which the paint follows. */
+                float lx, ly;
+            };
+
+            int m_width;
+            int m_height;
+            unsigned m_thread_count;
+            std::vector<uint8_t> m_color;
+            std::vector<uint8_t> m_stencil;
+
+            /* Per-flush state shared by every tile. */
+            int m_flags = 0;
+            float m_scale_x = 1.0f;
+            float m_scale_y = 1.0f;
+            uint8_t m_stroke_stencil_ref = 0;
+            std::vector<Vertex> m_vertices;
+            std::vector<uint32_t> m_indices;
+            std::vector<Pass> m_passes;
+
+            void AddPasses(const DKNVGcall &call, int frag_size);
+            Vertex MoveVertex(const Vertex &vertex, const DKNVGinstance &instance) const;
+            void RasterizeTile(int tile_x, int tile_y);
+            void RasterizePass(const Pass &pass, int x0, int y0, int x1, int y1);
+            bool Shade(const Pass &pass, float u, float v, float px, float py, float lx, float ly, float *out);
+            void Sample(const Texture &texture, float u, float v, float *out);
+        public:
+            /* A thread count of zero uses every hardware thread. */
+            SwRenderer(int width, int height, unsigned thread_count = 0);
+
+            void Flush(DKNVGcontext &ctx) override;
+
+            void Clear(NVGcolor color);
+
+            int GetWidth() const;
+            int GetHeight() const;
+            /* Premultiplied RGBA8 pixels, row by row from the top. */
+            const uint8_t *GetPixels() const;
+    };
+
+}
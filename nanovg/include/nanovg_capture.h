@@ -0,0 +1,39 @@
+#ifndef NANOVG_CAPTURE_H
+#define NANOVG_CAPTURE_H
+
+#include "nanovg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Records the render calls a context makes to its back-end into a binary trace, which can then be
+// replayed into the back-end of any other context.
+//
+// Everything going through NVGparams is recorded: viewport, cancel, flush, fills, strokes, triangles
+// along with their paint, scissor and vertices, and texture creation, updates and deletion.
+// The trace uses the native byte order and float format of the machine recording it.
+//
+// Images created before the capture starts are recorded as blank images of the same size when first
+// used, except for the font atlas whose contents are recorded when the capture begins. Start the
+// capture before loading images to keep their contents.
+
+typedef struct NVGcapture NVGcapture;
+
+// Starts recording the render calls of ctx into the file at path. Returns NULL on failure.
+NVGcapture* nvgCaptureBegin(NVGcontext* ctx, const char* path);
+
+// Stops recording, gives the context its back-end back and closes the trace.
+// Must be called before the context is deleted. Returns 0 if any part of the trace could not be
+// written, e.g. because the disk is full, in which case the file is truncated.
+int nvgCaptureEnd(NVGcapture* cap);
+
+// Feeds the trace at path into the back-end of ctx, bypassing its front end.
+// Returns the number of frames replayed, or -1 if the trace could not be read.
+int nvgReplayTrace(NVGcontext* ctx, const char* path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NANOVG_CAPTURE_H
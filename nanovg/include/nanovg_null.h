@@ -0,0 +1,23 @@
+#pragma once
+
+#include "nanovg.h"
+#include "nanovg/dknvg_frontend.h"
+#include "nanovg/null_renderer.hpp"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Creates a context which records its frames into host memory only, for use without a GPU.
+NVGcontext* nvgCreateNull(nvg::NullRenderer *renderer, int flags) {
+    return dknvg__createContext(renderer, flags);
+}
+
+void nvgDeleteNull(NVGcontext* ctx)
+{
+    nvgDeleteInternal(ctx);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "nanovg.h"
+#include "nanovg/dknvg_frontend.h"
+#include "nanovg/sw_renderer.hpp"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Creates a context rasterizing its frames on the CPU, into the renderer's RGBA buffer.
+NVGcontext* nvgCreateSw(nvg::SwRenderer *renderer, int flags) {
+    return dknvg__createContext(renderer, flags);
+}
+
+void nvgDeleteSw(NVGcontext* ctx)
+{
+    nvgDeleteInternal(ctx);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,49 @@
+#ifndef NANOVG_TRACE_H
+#define NANOVG_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Scoped timing zones for finding where frame time goes, exported as Chrome trace JSON which
+// chrome://tracing and ui.perfetto.dev can open.
+//
+// Zones are compiled out unless the library is built with NVG_TRACE defined. Each thread records
+// into its own fixed-size ring, without locking, keeping only its most recent zones.
+
+// Number of zones kept per thread.
+#ifndef NVG_TRACE_RING_SIZE
+#define NVG_TRACE_RING_SIZE 0x4000
+#endif
+
+typedef struct NVGtraceZone {
+	const char* name;
+	unsigned long long start;
+} NVGtraceZone;
+
+NVGtraceZone nvgTraceZoneBegin(const char* name);
+void nvgTraceZoneEnd(NVGtraceZone* zone);
+
+// Writes the zones recorded by every thread to path as Chrome trace JSON.
+// Returns the number of zones written, or -1 if tracing is compiled out or the file can't be written.
+// Zones still being recorded while the dump runs may be missing from it.
+int nvgTraceDump(const char* path);
+
+// Forgets every zone recorded so far.
+void nvgTraceClear(void);
+
+#ifdef NVG_TRACE
+#define NVG_TRACE_CONCAT_(a, b) a##b
+#define NVG_TRACE_CONCAT(a, b) NVG_TRACE_CONCAT_(a, b)
+// Times the rest of the enclosing scope. name must be a string literal, or otherwise outlive the dump.
+#define NVG_TRACE_ZONE(name) \
+	NVGtraceZone NVG_TRACE_CONCAT(nvg__traceZone, __LINE__) __attribute__((cleanup(nvgTraceZoneEnd), unused)) = nvgTraceZoneBegin(name)
+#else
+#define NVG_TRACE_ZONE(name)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NANOVG_TRACE_H
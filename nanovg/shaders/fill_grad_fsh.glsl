@@ -0,0 +1,50 @@
+#version 460
+
+layout(binding = 0) uniform sampler2D tex;
+
+layout(std140, binding = 0) uniform frag {
+    mat3 scissorMat;
+    mat3 paintMat;
+    vec4 innerCol;
+    vec4 outerCol;
+    vec2 scissorExt;
+    vec2 scissorScale;
+    vec2 extent;
+    float radius;
+    float feather;
+    float strokeMult;
+    float strokeThr;
+    int texType;
+    int type;
+};
+
+layout(location = 0) in vec2 ftcoord;
+layout(location = 1) in vec2 fpos;
+layout(location = 2) in vec2 fpaintpos;
+layout(location = 3) flat in vec4 ftint;
+layout(location = 0) out vec4 outColor;
+
+float sdroundrect(vec2 pt, vec2 ext, float rad) {
+    vec2 ext2 = ext - vec2(rad,rad);
+    vec2 d = abs(pt) - ext2;
+    return min(max(d.x,d.y),0.0) + length(max(d,0.0)) - rad;
+}
+
+// Scissoring
+float scissorMask(vec2 p) {
+    vec2 sc = (abs((scissorMat * vec3(p,1.0)).xy) - scissorExt);
+    sc = vec2(0.5,0.5) - sc * scissorScale;
+    return clamp(sc.x,0.0,1.0) * clamp(sc.y,0.0,1.0);
+}
+
+void main(void) {
+    float scissor = scissorMask(fpos);
+
+    // Calculate gradient color using box gradient
+    vec2 pt = (paintMat * vec3(fpaintpos,1.0)).xy;
+    float d = clamp((sdroundrect(pt, extent, radius) + feather*0.5) / feather, 0.0, 1.0);
+    vec4 color = mix(innerCol,outerCol,d);
+    // Combine scissor and instance tint
+    color *= ftint * scissor;
+    outColor = color;
+};
\ No newline at end of file
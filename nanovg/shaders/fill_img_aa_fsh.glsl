@@ -0,0 +1,56 @@
+#version 460
+
+layout(binding = 0) uniform sampler2D tex;
+
+layout(std140, binding = 0) uniform frag {
+    mat3 scissorMat;
+    mat3 paintMat;
+    vec4 innerCol;
+    vec4 outerCol;
+    vec2 scissorExt;
+    vec2 scissorScale;
+    vec2 extent;
+    float radius;
+    float feather;
+    float strokeMult;
+    float strokeThr;
+    int texType;
+    int type;
+};
+
+layout(location = 0) in vec2 ftcoord;
+layout(location = 1) in vec2 fpos;
+layout(location = 2) in vec2 fpaintpos;
+layout(location = 3) flat in vec4 ftint;
+layout(location = 0) out vec4 outColor;
+
+// Scissoring
+float scissorMask(vec2 p) {
+    vec2 sc = (abs((scissorMat * vec3(p,1.0)).xy) - scissorExt);
+    sc = vec2(0.5,0.5) - sc * scissorScale;
+    return clamp(sc.x,0.0,1.0) * clamp(sc.y,0.0,1.0);
+}
+
+// Stroke - from [0..1] to clipped pyramid, where the slope is 1px.
+float strokeMask() {
+    return min(1.0, (1.0-abs(ftcoord.x*2.0-1.0))*strokeMult) * min(1.0, ftcoord.y);
+}
+
+void main(void) {
+    float scissor = scissorMask(fpos);
+    float strokeAlpha = strokeMask();
+
+    if (strokeAlpha < strokeThr) discard;
+
+    // Calculate color fron texture
+    vec2 pt = (paintMat * vec3(fpaintpos,1.0)).xy / extent;
+    vec4 color = texture(tex, pt);
+
+    if (texType == 1) color = vec4(color.xyz*color.w,color.w);
+    if (texType == 2) color = vec4(color.x);
+    // Apply color tint and alpha.
+    color *= innerCol;
+    // Combine alpha and instance tint
+    color *= ftint * strokeAlpha * scissor;
+    outColor = color;
+};
\ No newline at end of file
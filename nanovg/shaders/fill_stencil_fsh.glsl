@@ -0,0 +1,8 @@
+#version 460
+
+// Only the stencil is written while filling the stencil, the colour doesn't matter.
+layout(location = 0) out vec4 outColor;
+
+void main(void) {
+    outColor = vec4(1,1,1,1);
+};
\ No newline at end of file
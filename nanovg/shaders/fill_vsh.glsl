@@ -2,8 +2,13 @@
 
 layout (location = 0) in vec2 vertex;
 layout (location = 1) in vec2 tcoord;
+layout (location = 2) in vec4 instXform;
+layout (location = 3) in vec2 instOffset;
+layout (location = 4) in vec4 instTint;
 layout (location = 0) out vec2 ftcoord;
 layout (location = 1) out vec2 fpos;
+layout (location = 2) out vec2 fpaintpos;
+layout (location = 3) flat out vec4 ftint;
 
 layout (std140, binding = 0) uniform View
 {
@@ -11,7 +16,11 @@ layout (std140, binding = 0) uniform View
 } view;
 
 void main(void) {
+    // Instances move the path into place, its paint moves along with it.
+    vec2 pos = mat2(instXform.xy, instXform.zw) * vertex + instOffset;
     ftcoord = tcoord;
-    fpos = vertex;
-    gl_Position = vec4(2.0*vertex.x/view.size.x - 1.0, 1.0 - 2.0*vertex.y/view.size.y, 0, 1);
+    fpos = pos;
+    fpaintpos = vertex;
+    ftint = instTint;
+    gl_Position = vec4(2.0*pos.x/view.size.x - 1.0, 1.0 - 2.0*pos.y/view.size.y, 0, 1);
 };
\ No newline at end of file
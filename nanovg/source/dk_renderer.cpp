@@ -1,5 +1,7 @@
 #include "dk_renderer.hpp"
+#include "nanovg_trace.h"
 
+#include <algorithm>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -11,56 +13,300 @@
 #define GLM_FORCE_INTRINSICS               /* Enables usage of SIMD CPU instructions (requiring the above as well). */
 #include <glm/vec2.hpp>
 
+static_assert(DKNVG_UNIFORM_ALIGNMENT == DK_UNIFORM_BUF_ALIGNMENT, "Fragment uniform alignment doesn't match deko3d's");
+
 namespace nvg {
 
     namespace {
 
-        constexpr std::array VertexBufferState = { DkVtxBufferState{sizeof(NVGvertex), 0}, };
+        /* Vertices come from the first buffer, and the transform and tint of each instance from the second. */
+        constexpr std::array VertexBufferState = {
+            DkVtxBufferState{sizeof(NVGvertex), 0},
+            DkVtxBufferState{sizeof(DKNVGinstance), 1},
+        };
 
         constexpr std::array VertexAttribState = {
             DkVtxAttribState{0, 0, offsetof(NVGvertex, x), DkVtxAttribSize_2x32, DkVtxAttribType_Float, 0},
             DkVtxAttribState{0, 0, offsetof(NVGvertex, u), DkVtxAttribSize_2x32, DkVtxAttribType_Float, 0},
+            DkVtxAttribState{1, 0, offsetof(DKNVGinstance, xform), DkVtxAttribSize_4x32, DkVtxAttribType_Float, 0},
+            DkVtxAttribState{1, 0, offsetof(DKNVGinstance, xform) + 4 * sizeof(float), DkVtxAttribSize_2x32, DkVtxAttribType_Float, 0},
+            DkVtxAttribState{1, 0, offsetof(DKNVGinstance, tint), DkVtxAttribSize_4x32, DkVtxAttribType_Float, 0},
         };
 
+        /* Calls which aren't instanced draw the identity instance at the front of the instance buffer, the recorded ones follow it. */
+        constexpr DKNVGinstance IdentityInstance = { {1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f}, {{{1.0f, 1.0f, 1.0f, 1.0f}}} };
+
+        constexpr u32 InstanceCount(const DKNVGcall &call) {
+            return call.instanceCount > 0 ? call.instanceCount : 1;
+        }
+
+        constexpr u32 FirstInstance(const DKNVGcall &call) {
+            return call.instanceCount > 0 ? call.instanceOffset + 1 : 0;
+        }
+
         struct View {
             glm::vec2 size;
         };
 
-        void UpdateImage(dk::Image &image, CMemPool &scratchPool, dk::Device device, dk::Queue transferQueue, int type, int x, int y, int w, int h, const u8 *data) {
-            /* Do not proceed if no data is provided upfront. */
-            if (data == nullptr) {
-                return;
+        constexpr size_t AlignUp(size_t value, size_t alignment) {
+            return (value + alignment - 1) &~ (alignment - 1);
+        }
+
+        DkBlendFactor ConvertBlendFactor(int factor) {
+            switch (factor) {
+                case NVG_ZERO:
+                    return DkBlendFactor_Zero;
+                case NVG_ONE:
+                    return DkBlendFactor_One;
+                case NVG_SRC_COLOR:
+                    return DkBlendFactor_SrcColor;
+                case NVG_ONE_MINUS_SRC_COLOR:
+                    return DkBlendFactor_InvSrcColor;
+                case NVG_DST_COLOR:
+                    return DkBlendFactor_DstColor;
+                case NVG_ONE_MINUS_DST_COLOR:
+                    return DkBlendFactor_InvDstColor;
+                case NVG_SRC_ALPHA:
+                    return DkBlendFactor_SrcAlpha;
+                case NVG_ONE_MINUS_SRC_ALPHA:
+                    return DkBlendFactor_InvSrcAlpha;
+                case NVG_DST_ALPHA:
+                    return DkBlendFactor_DstAlpha;
+                case NVG_ONE_MINUS_DST_ALPHA:
+                    return DkBlendFactor_InvDstAlpha;
+                case NVG_SRC_ALPHA_SATURATE:
+                    return DkBlendFactor_SrcAlphaSaturate;
+                default:
+                    return DkBlendFactor_One;
+            }
+        }
+
+    }
+
+    void StateTracker::Begin(dk::CmdBuf cmd_buf) {
+        m_cmd_buf = cmd_buf;
+        m_valid = 0;
+        m_stats = {};
+    }
+
+    template<typename T>
+    bool StateTracker::Update(StateBit bit, T &current, const T &value) {
+        /* Skip the command if the state is known to already be set to the same value. */
+        if ((m_valid & bit) && memcmp(&current, &value, sizeof(T)) == 0) {
+            m_stats.skipped++;
+            return false;
+        }
+
+        current = value;
+        m_valid |= bit;
+        m_stats.emitted++;
+        return true;
+    }
+
+    void StateTracker::BindBlendState(const DkBlendState &state) {
+        if (this->Update(StateBit_Blend, m_blend_state, state)) {
+            m_cmd_buf.bindBlendStates(0, state);
+        }
+    }
+
+    void StateTracker::BindDepthStencilState(const DkDepthStencilState &state) {
+        if (this->Update(StateBit_DepthStencil, m_depth_stencil_state, state)) {
+            m_cmd_buf.bindDepthStencilState(state);
+        }
+    }
+
+    void StateTracker::BindColorWriteState(const DkColorWriteState &state) {
+        if (this->Update(StateBit_ColorWrite, m_color_write_state, state)) {
+            m_cmd_buf.bindColorWriteState(state);
+        }
+    }
+
+    void StateTracker::BindRasterizerState(const DkRasterizerState &state) {
+        if (this->Update(StateBit_Rasterizer, m_rasterizer_state, state)) {
+            m_cmd_buf.bindRasterizerState(state);
+        }
+    }
+
+    void StateTracker::SetStencil(DkFace face, u8 mask, u8 func_ref, u8 func_mask) {
+        const StencilParams params = { mask, func_ref, func_mask };
+        const bool front = (face & DkFace_Front) && (!(m_valid & StateBit_StencilFront) || memcmp(&m_stencil[0], &params, sizeof(params)) != 0);
+        const bool back = (face & DkFace_Back) && (!(m_valid & StateBit_StencilBack) || memcmp(&m_stencil[1], &params, sizeof(params)) != 0);
+
+        if (!front && !back) {
+            m_stats.skipped++;
+            return;
+        }
+
+        /* Only update the faces which actually differ. */
+        if (front) {
+            m_stencil[0] = params;
+            m_valid |= StateBit_StencilFront;
+        }
+        if (back) {
+            m_stencil[1] = params;
+            m_valid |= StateBit_StencilBack;
+        }
+
+        m_stats.emitted++;
+        m_cmd_buf.setStencil(front && back ? DkFace_FrontAndBack : (front ? DkFace_Front : DkFace_Back), mask, func_ref, func_mask);
+    }
+
+    void StateTracker::BindFragmentUniforms(DkGpuAddr addr, u32 size) {
+        if (this->Update(StateBit_FragUniforms, m_frag_uniform_addr, addr)) {
+            m_cmd_buf.bindUniformBuffer(DkStage_Fragment, 0, addr, size);
+        }
+    }
+
+    void StateTracker::BindFragmentTexture(DkResHandle handle) {
+        if (this->Update(StateBit_FragTexture, m_frag_texture, handle)) {
+            m_cmd_buf.bindTextures(DkStage_Fragment, 0, handle);
+        }
+    }
+
+    void StateTracker::SetScissor(const DkScissor &scissor) {
+        if (this->Update(StateBit_Scissor, m_scissor, scissor)) {
+            m_cmd_buf.setScissors(0, scissor);
+        }
+    }
+
+    void StateTracker::BindFragmentShader(const DkShader *shader) {
+        if (this->Update(StateBit_FragShader, m_frag_shader, shader)) {
+            m_cmd_buf.bindShaders(DkStageFlag_Fragment, { shader });
+        }
+    }
+
+    const DkScissor &StateTracker::GetScissor() const {
+        return m_scissor;
+    }
+
+    const StateTracker::Stats &StateTracker::GetStats() const {
+        return m_stats;
+    }
+
+    bool UploadQueue::Initialize(dk::Device device, dk::Queue queue, CMemPool &pool) {
+        m_queue = queue;
+        m_cmd_buf = m_cmd_mem.createCmdBuf(device);
+        return m_cmd_mem.allocate(pool, BatchCmdSize, BatchStagingSize);
+    }
+
+    CCmdMemRing<UploadQueue::BatchCount>::DataHandle UploadQueue::AllocateStaging(u32 size) {
+        /* Start a new batch if needed, waiting for the GPU to be done with the one that last used its memory. */
+        if (m_recording && m_copies.size() >= MaxCopiesPerBatch) {
+            this->Submit();
+        }
+        if (!m_recording) {
+            NVG_TRACE_ZONE("UploadQueue::WaitForBatch");
+            m_cmd_mem.begin(m_cmd_buf);
+            m_recording = true;
+        }
+
+        auto staging = m_cmd_mem.allocateData(size, DK_IMAGE_LINEAR_STRIDE_ALIGNMENT);
+        if (!staging && !m_copies.empty()) {
+            /* The staging area of this batch is full, send it off and retry with a fresh one. */
+            this->Submit();
+            m_cmd_mem.begin(m_cmd_buf);
+            m_recording = true;
+            staging = m_cmd_mem.allocateData(size, DK_IMAGE_LINEAR_STRIDE_ALIGNMENT);
+        }
+        return staging;
+    }
+
+    bool UploadQueue::Upload(dk::Image &image, int type, int x, int y, int w, int h, const u8 *data, u32 pitch) {
+        /* Do not proceed if no data is provided upfront. */
+        if (data == nullptr || w <= 0 || h <= 0) {
+            return true;
+        }
+
+        /* Coalesce with the latest copy to the same image still waiting in this batch, as long as the combined */
+        /* rect isn't much larger than the two. Data holds the whole image, so the merged copy is up to date. */
+        for (auto it = m_copies.rbegin(); it != m_copies.rend(); it++) {
+            if (it->image != &image) {
+                continue;
+            }
+
+            const int x0 = std::min<int>(x, it->x), y0 = std::min<int>(y, it->y);
+            const int x1 = std::max<int>(x + w, it->x + it->w), y1 = std::max<int>(y + h, it->y + it->h);
+            if (static_cast<u64>(x1 - x0) * (y1 - y0) <= static_cast<u64>(w) * h + static_cast<u64>(it->w) * it->h) {
+                m_copies.erase(std::next(it).base());
+                x = x0;
+                y = y0;
+                w = x1 - x0;
+                h = y1 - y0;
+            }
+            break;
+        }
+
+        const u32 bpp = type == NVG_TEXTURE_RGBA ? 4 : 1;
+        const u32 row_size = w * bpp;
+        const u32 max_rows = BatchStagingSize / row_size;
+        data += x * bpp;
+
+        /* Rects larger than a batch's staging area are copied in bands of rows. */
+        while (h > 0) {
+            const u32 rows = std::min<u32>(h, max_rows);
+            const auto staging = this->AllocateStaging(rows * row_size);
+            if (!staging) {
+                m_stats.failed++;
+                return false;
             }
 
-            /* Allocate memory from the pool for the image. */
-            const size_t imageSize = type == NVG_TEXTURE_RGBA ? w * h * 4 : w * h;
-            CMemPool::Handle tempimgmem = scratchPool.allocate(imageSize, DK_IMAGE_LINEAR_STRIDE_ALIGNMENT);
-            memcpy(tempimgmem.getCpuAddr(), data, imageSize);
+            /* Pack the rows of the rect tightly into the staging memory. */
+            u8 *dst = static_cast<u8 *>(staging.getCpuAddr());
+            for (u32 row = 0; row < rows; row++) {
+                memcpy(dst + row * row_size, data + (y + row) * pitch, row_size);
+            }
+
+            m_copies.push_back(Copy{&image, staging.getGpuAddr(), static_cast<u32>(x), static_cast<u32>(y), static_cast<u32>(w), rows});
+            m_stats.staged_bytes += rows * row_size;
+            y += rows;
+            h -= rows;
+        }
+        return true;
+    }
+
+    void UploadQueue::Submit() {
+        if (!m_recording) {
+            return;
+        }
 
-            dk::UniqueCmdBuf tempcmdbuf = dk::CmdBufMaker{device}.create();
-            CMemPool::Handle tempcmdmem = scratchPool.allocate(DK_MEMBLOCK_ALIGNMENT);
-            tempcmdbuf.addMemory(tempcmdmem.getMemBlock(), tempcmdmem.getOffset(), tempcmdmem.getSize());
+        NVG_TRACE_ZONE("UploadQueue::Submit");
 
-            dk::ImageView imageView{image};
-            tempcmdbuf.copyBufferToImage({ tempimgmem.getGpuAddr() }, imageView, { static_cast<uint32_t>(x), static_cast<uint32_t>(y), 0, static_cast<uint32_t>(w), static_cast<uint32_t>(h), 1 });
+        /* Earlier frames may still be sampling the images about to be overwritten, hold the copies back until they are done. */
+        if (!m_copies.empty()) {
+            m_cmd_buf.barrier(DkBarrier_Full, 0);
+        }
 
-            transferQueue.submitCommands(tempcmdbuf.finishList());
-            transferQueue.waitIdle();
+        for (const Copy &copy : m_copies) {
+            dk::ImageView image_view{*copy.image};
+            m_cmd_buf.copyBufferToImage({ copy.staging_addr }, image_view, { copy.x, copy.y, 0, copy.w, copy.h, 1 });
+        }
+        m_stats.copies += m_copies.size();
 
-            /* Destroy temp mem. */
-            tempcmdmem.destroy();
-            tempimgmem.destroy();
+        /* Make the copies visible to anything submitted after them. */
+        if (!m_copies.empty()) {
+            m_cmd_buf.barrier(DkBarrier_Full, DkInvalidateFlags_Image);
         }
 
+        m_queue.submitCommands(m_cmd_mem.end(m_cmd_buf));
+        m_copies.clear();
+        m_recording = false;
+    }
+
+    const UploadQueue::Stats &UploadQueue::GetStats() const {
+        return m_stats;
+    }
+
+    void UploadQueue::ResetStats() {
+        m_stats = {};
     }
 
-    Texture::Texture(int id) : m_id(id) { /* ... */ }
+    Texture::Texture(int id, int descriptor_id) : m_id(id), m_descriptor_id(descriptor_id) { /* ... */ }
 
     Texture::~Texture() {
         m_image_mem.destroy();
     }
 
-    void Texture::Initialize(CMemPool &image_pool, CMemPool &scratch_pool, dk::Device device, dk::Queue queue, int type, int w, int h, int image_flags, const u8 *data) {
+    void Texture::Initialize(CMemPool &image_pool, dk::Device device, int type, int w, int h, int image_flags) {
         m_texture_descriptor = {
             .width = w,
             .height = h,
@@ -82,17 +328,16 @@ namespace nvg {
         m_image_mem = image_pool.allocate(layout.getSize(), layout.getAlignment());
         m_image.initialize(layout, m_image_mem.getMemBlock(), m_image_mem.getOffset());
         m_image_descriptor.initialize(m_image);
-
-        /* Only update the image if the data isn't null. */
-        if (data != nullptr) {
-            UpdateImage(m_image, scratch_pool, device, queue, type, 0, 0, w, h, data);
-        }
     }
 
     int Texture::GetId() {
         return m_id;
     }
 
+    int Texture::GetDescriptorId() {
+        return m_descriptor_id;
+    }
+
     const DKNVGtextureDescriptor &Texture::GetDescriptor() {
         return m_texture_descriptor;
     }
@@ -106,18 +351,18 @@ namespace nvg {
     }
 
     DkRenderer::DkRenderer(unsigned int view_width, unsigned int view_height, dk::Device device, dk::Queue queue, CMemPool &image_mem_pool, CMemPool &code_mem_pool, CMemPool &data_mem_pool) :
-        m_view_width(view_width), m_view_height(view_height), m_device(device), m_queue(queue), m_image_mem_pool(image_mem_pool), m_code_mem_pool(code_mem_pool), m_data_mem_pool(data_mem_pool), m_image_descriptor_mappings({0})
+        m_view_width(view_width), m_view_height(view_height), m_device(device), m_queue(queue), m_image_mem_pool(image_mem_pool), m_code_mem_pool(code_mem_pool), m_data_mem_pool(data_mem_pool)
     {
-        /* Create a dynamic command buffer and allocate memory for it. */
-        m_dyn_cmd_buf = dk::CmdBufMaker{m_device}.create();
-        m_dyn_cmd_mem.allocate(m_data_mem_pool, DynamicCmdSize);
+        /* Create a dynamic command buffer and allocate per-frame command and data memory for it. */
+        m_dyn_cmd_buf = m_dyn_cmd_mem.createCmdBuf(m_device);
+        m_dyn_cmd_mem.allocate(m_data_mem_pool, DynamicCmdSize, DynamicDataSize);
+
+        /* Texture uploads are recorded separately, so that they can be queued up at any time. */
+        m_uploads.Initialize(m_device, m_queue, m_data_mem_pool);
 
         m_image_descriptor_set.allocate(m_data_mem_pool);
         m_sampler_descriptor_set.allocate(m_data_mem_pool);
 
-        m_view_uniform_buffer = m_data_mem_pool.allocate(sizeof(View), DK_UNIFORM_BUF_ALIGNMENT);
-        m_frag_uniform_buffer = m_data_mem_pool.allocate(sizeof(FragmentUniformSize), DK_UNIFORM_BUF_ALIGNMENT);
-
         /* Create and bind preset samplers. */
         dk::UniqueCmdBuf init_cmd_buf = dk::CmdBufMaker{m_device}.create();
         CMemPool::Handle init_cmd_mem = m_data_mem_pool.allocate(DK_MEMBLOCK_ALIGNMENT);
@@ -151,79 +396,122 @@ namespace nvg {
     }
 
     DkRenderer::~DkRenderer() {
-        if (m_vertex_buffer) {
-            m_vertex_buffer->destroy();
-        }
+        /* Frames may still be in flight, wait for them before releasing their memory. */
+        m_queue.waitIdle();
 
-        m_view_uniform_buffer.destroy();
-        m_frag_uniform_buffer.destroy();
-        m_textures.clear();
+        m_retired_textures.clear();
+        m_texture_slots.clear();
     }
 
-    int DkRenderer::AcquireImageDescriptor(std::shared_ptr<Texture> texture, int image) {
-        int free_image_descriptor = m_last_image_descriptor + 1;
-        int mapping = 0;
-
-        for (int desc = 0; desc <= m_last_image_descriptor; desc++) {
-            mapping = m_image_descriptor_mappings[desc];
+    void DkRenderer::UpdateImageDescriptors() {
+        if (m_pending_descriptors.empty()) {
+            return;
+        }
 
-            /* We've found the image descriptor requested. */
-            if (mapping == image) {
-                return desc;
+        /* Write the descriptors of textures created since the last flush, skipping any that were deleted in between. */
+        for (const int id : m_pending_descriptors) {
+            Texture *texture = this->FindTexture(id);
+            if (texture != nullptr) {
+                m_image_descriptor_set.update(m_dyn_cmd_buf, texture->GetDescriptorId(), texture->GetImageDescriptor());
             }
+        }
+        m_pending_descriptors.clear();
 
-            /* Update the free image descriptor. */
-            if (mapping == 0 && free_image_descriptor == m_last_image_descriptor + 1) {
-                free_image_descriptor = desc;
-            }
+        /* Flush the descriptor cache once for all of them. */
+        m_dyn_cmd_buf.barrier(DkBarrier_None, DkInvalidateFlags_Descriptors);
+    }
+
+    void DkRenderer::ReleaseRetiredTextures(u64 completed_frames) {
+        /* Textures are retired in order, so stop at the first one which may still be in use. */
+        auto it = m_retired_textures.begin();
+        for (; it != m_retired_textures.end() && it->last_frame < completed_frames; it++) {
+            m_image_descriptor_set.freeId(it->texture->GetDescriptorId());
         }
+        m_retired_textures.erase(m_retired_textures.begin(), it);
+    }
 
-        /* No descriptors are free. */
-        if (free_image_descriptor >= static_cast<int>(MaxImages)) {
-            return -1;
+    bool DkRenderer::UpdateVertexBuffer(const void *data, size_t size) {
+        /* Sub-allocate the vertex buffer from the data area of the current frame. */
+        const auto vertex_buffer = m_dyn_cmd_mem.allocateData(size);
+        if (!vertex_buffer) {
+            return false;
         }
 
-        /* Update descriptor sets. */
-        m_image_descriptor_set.update(m_dyn_cmd_buf, free_image_descriptor, texture->GetImageDescriptor());
+        memcpy(vertex_buffer.getCpuAddr(), data, size);
+        m_dyn_cmd_buf.bindVtxBuffer(0, vertex_buffer.getGpuAddr(), vertex_buffer.getSize());
+        m_stats.vertexBytes += size;
+        return true;
+    }
 
-        /* Flush the descriptor cache. */
-        m_dyn_cmd_buf.barrier(DkBarrier_None, DkInvalidateFlags_Descriptors);
+    bool DkRenderer::UpdateInstanceBuffer(const DKNVGcontext &ctx) {
+        const size_t size = (ctx.ninstances + 1) * sizeof(DKNVGinstance);
+        const auto instance_buffer = m_dyn_cmd_mem.allocateData(size);
+        if (!instance_buffer) {
+            return false;
+        }
 
-        /* Update the map. */
-        m_image_descriptor_mappings[free_image_descriptor] = image;
-        m_last_image_descriptor = free_image_descriptor;
-        return free_image_descriptor;
+        auto instances = static_cast<DKNVGinstance *>(instance_buffer.getCpuAddr());
+        instances[0] = IdentityInstance;
+        memcpy(instances + 1, ctx.instances, ctx.ninstances * sizeof(DKNVGinstance));
+        m_dyn_cmd_buf.bindVtxBuffer(1, instance_buffer.getGpuAddr(), instance_buffer.getSize());
+        m_stats.vertexBytes += size;
+        return true;
     }
 
-    void DkRenderer::FreeImageDescriptor(int image) {
-        for (int desc = 0; desc <= m_last_image_descriptor; desc++) {
-            if (m_image_descriptor_mappings[desc] == image) {
-                m_image_descriptor_mappings[desc] = 0;
-            }
+    bool DkRenderer::UpdateViewUniforms() {
+        const auto view_buffer = m_dyn_cmd_mem.allocateData(sizeof(View));
+        if (!view_buffer) {
+            return false;
         }
+
+        /* Write the view size to the uniform buffer and bind it. */
+        const auto view = View{glm::vec2{m_view_width, m_view_height}};
+        memcpy(view_buffer.getCpuAddr(), &view, sizeof(view));
+        m_dyn_cmd_buf.bindUniformBuffer(DkStage_Vertex, 0, view_buffer.getGpuAddr(), view_buffer.getSize());
+        m_stats.uniformBytes += sizeof(view);
+        return true;
     }
 
-    void DkRenderer::UpdateVertexBuffer(const void *data, size_t size) {
-        /* Destroy the existing vertex buffer if it is too small. */
-        if (m_vertex_buffer && m_vertex_buffer->getSize() < size) {
-            m_vertex_buffer->destroy();
-            m_vertex_buffer.reset();
+    bool DkRenderer::UpdateFragmentUniforms(const void *data, size_t size) {
+        /* Upload every uniform block of the frame at once, calls then only bind their offset into it. */
+        const auto uniform_buffer = m_dyn_cmd_mem.allocateData(size);
+        if (!uniform_buffer) {
+            m_frag_uniform_addr = DK_GPU_ADDR_INVALID;
+            return false;
         }
 
-        /* Create a new buffer if needed. */
-        if (!m_vertex_buffer) {
-            m_vertex_buffer = m_data_mem_pool.allocate(size);
+        memcpy(uniform_buffer.getCpuAddr(), data, size);
+        m_frag_uniform_addr = uniform_buffer.getGpuAddr();
+        m_stats.uniformBytes += size;
+        return true;
+    }
+
+    bool DkRenderer::UpdateIndexBuffer(const DKNVGcontext &ctx, int count) {
+        /* Use 16-bit indices whenever every vertex of the frame can be addressed with them. */
+        const bool use_u16 = ctx.nverts <= 0x10000;
+        const auto index_buffer = m_dyn_cmd_mem.allocateData(count * (use_u16 ? sizeof(u16) : sizeof(u32)));
+        if (!index_buffer) {
+            return false;
         }
 
-        /* Copy data to the vertex buffer if it exists. */
-        if (m_vertex_buffer) {
-            memcpy(m_vertex_buffer->getCpuAddr(), data, size);
+        m_stats.indexBytes += index_buffer.getSize();
+
+        /* Write the indices straight into GPU memory. */
+        if (use_u16) {
+            WriteIndices(ctx, static_cast<u16 *>(index_buffer.getCpuAddr()));
+            m_dyn_cmd_buf.bindIdxBuffer(DkIdxFormat_Uint16, index_buffer.getGpuAddr());
+        } else {
+            WriteIndices(ctx, static_cast<u32 *>(index_buffer.getCpuAddr()));
+            m_dyn_cmd_buf.bindIdxBuffer(DkIdxFormat_Uint32, index_buffer.getGpuAddr());
         }
+        return true;
     }
 
     void DkRenderer::SetUniforms(const DKNVGcontext &ctx, int offset, int image) {
-        m_dyn_cmd_buf.pushConstants(m_frag_uniform_buffer.getGpuAddr(), m_frag_uniform_buffer.getSize(), 0, ctx.fragSize, ctx.uniforms + offset);
-        m_dyn_cmd_buf.bindUniformBuffer(DkStage_Fragment, 0, m_frag_uniform_buffer.getGpuAddr(), m_frag_uniform_buffer.getSize());
+        /* Use the shader variant made for the kind of paint these uniforms describe. */
+        const auto frag = reinterpret_cast<const DKNVGfragUniforms *>(ctx.uniforms + offset);
+        m_state.BindFragmentShader(m_fragment_shaders[frag->type]);
+        m_state.BindFragmentUniforms(m_frag_uniform_addr + offset, FragmentUniformSize);
 
         /* Attempt to find a texture. */
         const auto texture = this->FindTexture(image);
@@ -231,12 +519,7 @@ namespace nvg {
             return;
         }
 
-        /* Acquire an image descriptor. */
-        const int image_desc_id = this->AcquireImageDescriptor(texture, image);
-        if (image_desc_id == -1) {
-            return;
-        }
-
+        const int image_desc_id = texture->GetDescriptorId();
         const int image_flags = texture->GetDescriptor().flags;
         uint32_t sampler_id = 0;
 
@@ -245,15 +528,83 @@ namespace nvg {
         if (image_flags & NVG_IMAGE_REPEATX)          sampler_id |= SamplerType_RepeatX;
         if (image_flags & NVG_IMAGE_REPEATY)          sampler_id |= SamplerType_RepeatY;
 
-        m_dyn_cmd_buf.bindTextures(DkStage_Fragment, 0, dkMakeTextureHandle(image_desc_id, sampler_id));
+        m_state.BindFragmentTexture(dkMakeTextureHandle(image_desc_id, sampler_id));
+    }
+
+    void DkRenderer::Draw(DkPrimitive primitive, u32 vertex_count, u32 first_vertex, u32 instance_count, u32 first_instance) {
+        m_dyn_cmd_buf.draw(primitive, vertex_count, instance_count, first_vertex, first_instance);
+        m_stats.draws++;
+    }
+
+    void DkRenderer::DrawIndexed(u32 index_count, u32 first_index, u32 instance_count, u32 first_instance) {
+        m_dyn_cmd_buf.drawIndexed(DkPrimitive_Triangles, index_count, instance_count, first_index, 0, first_instance);
+        m_stats.draws++;
+    }
+
+    DkScissor DkRenderer::GetScissorRect(const DKNVGcontext &ctx, const DKNVGcall &call) const {
+        const float scale_x = ctx.view[0] > 0.0f ? m_view_width / ctx.view[0] : 1.0f;
+        const float scale_y = ctx.view[1] > 0.0f ? m_view_height / ctx.view[1] : 1.0f;
+
+        /* Round the scissor bounds out to whole pixels, within the render target. */
+        const float x0 = std::max(floorf(call.scissorBounds[0] * scale_x), 0.0f);
+        const float y0 = std::max(floorf(call.scissorBounds[1] * scale_y), 0.0f);
+        const float x1 = std::min(ceilf(call.scissorBounds[2] * scale_x), static_cast<float>(m_view_width));
+        const float y1 = std::min(ceilf(call.scissorBounds[3] * scale_y), static_cast<float>(m_view_height));
+        if (x1 <= x0 || y1 <= y0) {
+            return DkScissor{};
+        }
+
+        return DkScissor{static_cast<u32>(x0), static_cast<u32>(y0), static_cast<u32>(x1 - x0), static_cast<u32>(y1 - y0)};
+    }
+
+    void DkRenderer::ClipFillQuads(DKNVGcontext &ctx) {
+        const float scale_x = ctx.view[0] > 0.0f ? m_view_width / ctx.view[0] : 1.0f;
+        const float scale_y = ctx.view[1] > 0.0f ? m_view_height / ctx.view[1] : 1.0f;
+
+        for (int i = 0; i < ctx.ncalls; i++) {
+            const DKNVGcall &call = ctx.calls[i];
+
+            /* Instanced quads are only moved into place by the vertex shader, they are left whole. */
+            if (call.type != DKNVG_FILL || call.instanceCount != 0) {
+                continue;
+            }
+
+            /* The stencil pass is confined to the scissor rect, so the cover quad only has to reach as far. */
+            const DkScissor rect = this->GetScissorRect(ctx, call);
+            const float x0 = rect.x / scale_x, x1 = (rect.x + rect.width) / scale_x;
+            const float y0 = rect.y / scale_y, y1 = (rect.y + rect.height) / scale_y;
+            for (int j = 0; j < call.triangleCount; j++) {
+                NVGvertex &vertex = ctx.verts[call.triangleOffset + j];
+                vertex.x = std::min(std::max(vertex.x, x0), x1);
+                vertex.y = std::min(std::max(vertex.y, y0), y1);
+            }
+        }
+    }
+
+    u8 DkRenderer::NextStrokeStencilRef() {
+        /* Every value has been used since the stroke bits were last cleared, start over from a clean slate. */
+        if (m_stroke_stencil_ref == MaxStrokeStencilRef) {
+            /* Clears are scissored too, so lift the stroke's scissor for the time of it. */
+            const DkScissor scissor = m_state.GetScissor();
+            m_state.SetScissor(DkScissor{0, 0, m_view_width, m_view_height});
+            m_dyn_cmd_buf.clearDepthStencil(false, 0.0f, StrokeStencilMask, 0);
+            m_state.SetScissor(scissor);
+            m_stroke_stencil_ref = 0;
+        }
+
+        return ++m_stroke_stencil_ref;
     }
 
     void DkRenderer::DrawFill(const DKNVGcontext &ctx, const DKNVGcall &call) {
-        DKNVGpath *paths = &ctx.paths[call.pathOffset];
-        int npaths = call.pathCount;
+        /* Each instance needs the stencil to itself, so instanced fills are drawn one instance after the other. */
+        for (u32 i = 0; i < InstanceCount(call); i++) {
+            this->DrawFillInstance(ctx, call, FirstInstance(call) + i);
+        }
+    }
 
-        /* Set the stencils to be used. */
-        m_dyn_cmd_buf.setStencil(DkFace_FrontAndBack, 0xFF, 0x0, 0xFF);
+    void DkRenderer::DrawFillInstance(const DKNVGcontext &ctx, const DKNVGcall &call, u32 instance) {
+        /* Set the stencils to be used, fills only ever touch the winding bits. */
+        m_state.SetStencil(DkFace_FrontAndBack, FillStencilMask, 0x0, FillStencilMask);
 
         /* Set the depth stencil state. */
         auto depth_stencil_state = dk::DepthStencilState{}
@@ -266,21 +617,21 @@ namespace nvg {
             .setStencilBackFailOp(DkStencilOp_Keep)
             .setStencilBackDepthFailOp(DkStencilOp_Keep)
             .setStencilBackPassOp(DkStencilOp_DecrWrap);
-        m_dyn_cmd_buf.bindDepthStencilState(depth_stencil_state);
+        m_state.BindDepthStencilState(depth_stencil_state);
 
         /* Configure for shape drawing. */
-        m_dyn_cmd_buf.bindColorWriteState(dk::ColorWriteState{}.setMask(0, 0));
+        m_state.BindColorWriteState(dk::ColorWriteState{}.setMask(0, 0));
         this->SetUniforms(ctx, call.uniformOffset, 0);
-        m_dyn_cmd_buf.bindRasterizerState(dk::RasterizerState{}.setCullMode(DkFace_None));
+        m_state.BindRasterizerState(dk::RasterizerState{}.setCullMode(DkFace_None));
 
         /* Draw vertices. */
-        for (int i = 0; i < npaths; i++) {
-            m_dyn_cmd_buf.draw(DkPrimitive_TriangleFan, paths[i].fillCount, 1, paths[i].fillOffset, 0);
+        if (call.indexCount > 0) {
+            this->DrawIndexed(call.indexCount, call.indexOffset, 1, instance);
         }
 
-        m_dyn_cmd_buf.bindColorWriteState(dk::ColorWriteState{});
+        m_state.BindColorWriteState(dk::ColorWriteState{});
         this->SetUniforms(ctx, call.uniformOffset + ctx.fragSize, call.image);
-        m_dyn_cmd_buf.bindRasterizerState(dk::RasterizerState{});
+        m_state.BindRasterizerState(dk::RasterizerState{});
 
         if (ctx.flags & NVG_ANTIALIAS) {
             /* Configure stencil anti-aliasing. */
@@ -293,11 +644,11 @@ namespace nvg {
                 .setStencilBackFailOp(DkStencilOp_Keep)
                 .setStencilBackDepthFailOp(DkStencilOp_Keep)
                 .setStencilBackPassOp(DkStencilOp_Keep);
-            m_dyn_cmd_buf.bindDepthStencilState(depth_stencil_state);
+            m_state.BindDepthStencilState(depth_stencil_state);
 
             /* Draw fringes. */
-            for (int i = 0; i < npaths; i++) {
-                m_dyn_cmd_buf.draw(DkPrimitive_TriangleStrip, paths[i].strokeCount, 1, paths[i].strokeOffset, 0);
+            if (call.fringeIndexCount > 0) {
+                this->DrawIndexed(call.fringeIndexCount, call.fringeIndexOffset, 1, instance);
             }
         }
 
@@ -311,102 +662,97 @@ namespace nvg {
             .setStencilBackFailOp(DkStencilOp_Zero)
             .setStencilBackDepthFailOp(DkStencilOp_Zero)
             .setStencilBackPassOp(DkStencilOp_Zero);
-        m_dyn_cmd_buf.bindDepthStencilState(depth_stencil_state);
+        m_state.BindDepthStencilState(depth_stencil_state);
 
-        m_dyn_cmd_buf.draw(DkPrimitive_TriangleStrip, call.triangleCount, 1, call.triangleOffset, 0);
-
-        /* Reset the depth stencil state to default. */
-        m_dyn_cmd_buf.bindDepthStencilState(dk::DepthStencilState{});
+        this->Draw(DkPrimitive_TriangleStrip, call.triangleCount, call.triangleOffset, 1, instance);
     }
 
     void DkRenderer::DrawConvexFill(const DKNVGcontext &ctx, const DKNVGcall &call) {
-        DKNVGpath *paths = &ctx.paths[call.pathOffset];
-        int npaths = call.pathCount;
-
+        this->BindDefaultStates();
         this->SetUniforms(ctx, call.uniformOffset, call.image);
 
-        for (int i = 0; i < npaths; i++) {
-            m_dyn_cmd_buf.draw(DkPrimitive_TriangleFan, paths[i].fillCount, 1, paths[i].fillOffset, 0);
-
-            /* Draw fringes. */
-            if (paths[i].strokeCount > 0) {
-                m_dyn_cmd_buf.draw(DkPrimitive_TriangleStrip, paths[i].strokeCount, 1, paths[i].strokeOffset, 0);
-            }
+        /* Draw the fills and fringes of all merged paths, or of every instance, at once. */
+        if (call.indexCount > 0) {
+            this->DrawIndexed(call.indexCount, call.indexOffset, InstanceCount(call), FirstInstance(call));
         }
     }
 
     void DkRenderer::DrawStroke(const DKNVGcontext &ctx, const DKNVGcall &call) {
-        DKNVGpath* paths = &ctx.paths[call.pathOffset];
-        int npaths = call.pathCount;
+        if (call.indexCount == 0) {
+            return;
+        }
 
-        if (ctx.flags & NVG_STENCIL_STROKES) {
-            /* Set the stencil to be used. */
-            m_dyn_cmd_buf.setStencil(DkFace_Front, 0xFF, 0x0, 0xFF);
+        /* Strokes which can't overlap themselves look the same without the stencil. */
+        if ((ctx.flags & NVG_STENCIL_STROKES) && !call.simpleStroke) {
+            /* Each stroke marks its pixels with a value of its own, so the marks don't need clearing afterwards. */
+            const u8 ref = this->NextStrokeStencilRef() << StrokeStencilShift;
+            m_state.SetStencil(DkFace_Front, StrokeStencilMask, ref, StrokeStencilMask);
+            m_state.BindColorWriteState(dk::ColorWriteState{});
+            m_state.BindRasterizerState(dk::RasterizerState{});
 
             /* Configure for filling the stroke base without overlap. */
             auto depth_stencil_state = dk::DepthStencilState{}
                 .setStencilTestEnable(true)
-                .setStencilFrontCompareOp(DkCompareOp_Equal)
+                .setStencilFrontCompareOp(DkCompareOp_NotEqual)
                 .setStencilFrontFailOp(DkStencilOp_Keep)
                 .setStencilFrontDepthFailOp(DkStencilOp_Keep)
-                .setStencilFrontPassOp(DkStencilOp_Incr);
-            m_dyn_cmd_buf.bindDepthStencilState(depth_stencil_state);
+                .setStencilFrontPassOp(DkStencilOp_Replace);
+            m_state.BindDepthStencilState(depth_stencil_state);
             this->SetUniforms(ctx, call.uniformOffset + ctx.fragSize, call.image);
 
             /* Draw vertices. */
-            for (int i = 0; i < npaths; i++) {
-                m_dyn_cmd_buf.draw(DkPrimitive_TriangleStrip, paths[i].strokeCount, 1, paths[i].strokeOffset, 0);
-            }
+            this->DrawIndexed(call.indexCount, call.indexOffset);
 
             /* Configure for drawing anti-aliased pixels. */
             depth_stencil_state.setStencilFrontPassOp(DkStencilOp_Keep);
-            m_dyn_cmd_buf.bindDepthStencilState(depth_stencil_state);
+            m_state.BindDepthStencilState(depth_stencil_state);
             this->SetUniforms(ctx, call.uniformOffset, call.image);
 
             /* Draw vertices. */
-            for (int i = 0; i < npaths; i++) {
-                m_dyn_cmd_buf.draw(DkPrimitive_TriangleStrip, paths[i].strokeCount, 1, paths[i].strokeOffset, 0);
-            }
-
-            /* Configure for clearing the stencil buffer. */
-            depth_stencil_state
-                .setStencilTestEnable(true)
-                .setStencilFrontCompareOp(DkCompareOp_Always)
-                .setStencilFrontFailOp(DkStencilOp_Zero)
-                .setStencilFrontDepthFailOp(DkStencilOp_Zero)
-                .setStencilFrontPassOp(DkStencilOp_Zero);
-            m_dyn_cmd_buf.bindDepthStencilState(depth_stencil_state);
-
-            /* Draw vertices. */
-            for (int i = 0; i < npaths; i++) {
-                m_dyn_cmd_buf.draw(DkPrimitive_TriangleStrip, paths[i].strokeCount, 1, paths[i].strokeOffset, 0);
-            }
-
-            /* Reset the depth stencil state to default. */
-            m_dyn_cmd_buf.bindDepthStencilState(dk::DepthStencilState{});
+            this->DrawIndexed(call.indexCount, call.indexOffset);
         } else {
+            this->BindDefaultStates();
             this->SetUniforms(ctx, call.uniformOffset, call.image);
 
             /* Draw vertices. */
-            for (int i = 0; i < npaths; i++) {
-                m_dyn_cmd_buf.draw(DkPrimitive_TriangleStrip, paths[i].strokeCount, 1, paths[i].strokeOffset, 0);
-            }
+            this->DrawIndexed(call.indexCount, call.indexOffset);
         }
     }
 
     void DkRenderer::DrawTriangles(const DKNVGcontext &ctx, const DKNVGcall &call) {
+        this->BindDefaultStates();
         this->SetUniforms(ctx, call.uniformOffset, call.image);
-        m_dyn_cmd_buf.draw(DkPrimitive_Triangles, call.triangleCount, 1, call.triangleOffset, 0);
+        this->Draw(DkPrimitive_Triangles, call.triangleCount, call.triangleOffset);
+    }
+
+    void DkRenderer::BindDefaultStates() {
+        /* Plain draws don't touch the stencil and write all colour channels. */
+        m_state.BindDepthStencilState(dk::DepthStencilState{});
+        m_state.BindColorWriteState(dk::ColorWriteState{});
+        m_state.BindRasterizerState(dk::RasterizerState{});
     }
 
     int DkRenderer::Create(DKNVGcontext &ctx) {
-        m_vertex_shader.load(m_code_mem_pool, "romfs:/shaders/fill_vsh.dksh");
+        if (!m_shader_archive.load(m_code_mem_pool, "romfs:/shaders/nanovg.dkshpak")) {
+            return 0;
+        }
+        m_vertex_shader = m_shader_archive.find("fill_vsh");
 
-        /* Load the appropriate fragment shader depending on whether AA is enabled. */
-        if (ctx.flags & NVG_ANTIALIAS) {
-            m_fragment_shader.load(m_code_mem_pool, "romfs:/shaders/fill_aa_fsh.dksh");
-        } else {
-            m_fragment_shader.load(m_code_mem_pool, "romfs:/shaders/fill_fsh.dksh");
+        /* Pick the paint shaders appropriate for whether AA is enabled. Textured triangles and the stencil don't use the stroke mask either way. */
+        const bool antialias = ctx.flags & NVG_ANTIALIAS;
+        m_fragment_shaders[FragmentShader_Gradient] = m_shader_archive.find(antialias ? "fill_grad_aa_fsh" : "fill_grad_fsh");
+        m_fragment_shaders[FragmentShader_Image] = m_shader_archive.find(antialias ? "fill_img_aa_fsh" : "fill_img_fsh");
+        m_fragment_shaders[FragmentShader_Shape] = m_shader_archive.find(antialias ? "fill_shape_aa_fsh" : "fill_shape_fsh");
+        m_fragment_shaders[FragmentShader_Stencil] = m_shader_archive.find("fill_stencil_fsh");
+        m_fragment_shaders[FragmentShader_Triangles] = m_shader_archive.find("fill_tris_fsh");
+
+        if (m_vertex_shader == nullptr) {
+            return 0;
+        }
+        for (const dk::Shader *shader : m_fragment_shaders) {
+            if (shader == nullptr) {
+                return 0;
+            }
         }
 
         /* Set the size of fragment uniforms. */
@@ -414,61 +760,93 @@ namespace nvg {
         return 1;
     }
 
-    std::shared_ptr<Texture> DkRenderer::FindTexture(int id) {
-        for (auto it = m_textures.begin(); it != m_textures.end(); it++) {
-            if ((*it)->GetId() == id) {
-                return *it;
-            }
+    Texture *DkRenderer::FindTexture(int id) {
+        /* Id 0 wraps around to an invalid slot. */
+        const size_t slot = static_cast<size_t>((id & TextureSlotMask) - 1);
+        if (slot >= m_texture_slots.size()) {
+            return nullptr;
         }
 
-        return nullptr;
+        /* A free slot holds no texture, and a reused one has moved on to a newer generation. */
+        const TextureSlot &entry = m_texture_slots[slot];
+        if (entry.generation != (id >> TextureSlotBits)) {
+            return nullptr;
+        }
+
+        return entry.texture.get();
     }
 
     int DkRenderer::CreateTexture(const DKNVGcontext &ctx, int type, int w, int h, int image_flags, const unsigned char* data) {
-        const auto texture_id = m_next_texture_id++;
-        auto texture = std::make_shared<Texture>(texture_id);
-        texture->Initialize(m_image_mem_pool, m_data_mem_pool, m_device, m_queue, type, w, h, image_flags, data);
-        m_textures.push_back(texture);
-        return texture->GetId();
+        /* Every texture keeps its image descriptor for its whole lifetime. */
+        const int descriptor_id = m_image_descriptor_set.allocateId();
+        if (descriptor_id == -1) {
+            m_stats.descriptorMisses++;
+            return 0;
+        }
+
+        int slot;
+
+        /* Reuse a free slot if possible, there can't be more textures than image descriptors. */
+        if (!m_free_texture_slots.empty()) {
+            slot = m_free_texture_slots.back();
+            m_free_texture_slots.pop_back();
+        } else if (m_texture_slots.size() < MaxImages) {
+            slot = m_texture_slots.size();
+            m_texture_slots.push_back(TextureSlot{nullptr, 0});
+        } else {
+            m_image_descriptor_set.freeId(descriptor_id);
+            m_stats.descriptorMisses++;
+            return 0;
+        }
+        m_stats.descriptorAcquires++;
+
+        TextureSlot &entry = m_texture_slots[slot];
+        entry.generation = entry.generation % MaxTextureGeneration + 1;
+
+        const int texture_id = (entry.generation << TextureSlotBits) | (slot + 1);
+        entry.texture = std::make_unique<Texture>(texture_id, descriptor_id);
+        entry.texture->Initialize(m_image_mem_pool, m_device, type, w, h, image_flags);
+
+        /* Only upload the image if the data isn't null, the copy is submitted along with the next flush. */
+        if (!m_uploads.Upload(entry.texture->GetImage(), type, 0, 0, w, h, data, type == NVG_TEXTURE_RGBA ? w * 4 : w)) {
+            /* Part of the image may already be queued for copying, so retire it like a deleted texture. */
+            m_free_texture_slots.push_back(slot);
+            m_retired_textures.push_back(RetiredTexture{std::move(entry.texture), m_frame_index});
+            return 0;
+        }
+
+        /* The descriptor itself is written by the next flush. */
+        m_pending_descriptors.push_back(texture_id);
+        return texture_id;
     }
 
     int DkRenderer::DeleteTexture(const DKNVGcontext &ctx, int image) {
-        bool found = false;
-
-        for (auto it = m_textures.begin(); it != m_textures.end();) {
-            /* Remove textures with the given id. */
-            if ((*it)->GetId() == image) {
-                it = m_textures.erase(it);
-                found = true;
-            } else {
-                ++it;
-            }
+        if (this->FindTexture(image) == nullptr) {
+            return 0;
         }
 
-        /* Free any used image descriptors. */
-        this->FreeImageDescriptor(image);
-        return found;
+        /* Make the slot available again, the id is invalidated by the generation check from now on. */
+        const int slot = (image & TextureSlotMask) - 1;
+        m_free_texture_slots.push_back(slot);
+
+        /* Keep the image and its descriptor around until the next frame has completed, as it may still have copies queued up. */
+        m_retired_textures.push_back(RetiredTexture{std::move(m_texture_slots[slot].texture), m_frame_index});
+        return 1;
     }
 
     int DkRenderer::UpdateTexture(const DKNVGcontext &ctx, int image, int x, int y, int w, int h, const unsigned char *data) {
-        const std::shared_ptr<Texture> texture = this->FindTexture(image);
+        NVG_TRACE_ZONE("DkRenderer::UpdateTexture");
+        Texture *texture = this->FindTexture(image);
 
         /* Could not find a texture. */
         if (texture == nullptr) {
             return 0;
         }
 
+        /* Only the dirty rect is uploaded, data holds the whole image. */
         const DKNVGtextureDescriptor &tex_desc = texture->GetDescriptor();
-        if (tex_desc.type == NVG_TEXTURE_RGBA) {
-            data += y * tex_desc.width*4;
-        } else {
-            data += y * tex_desc.width;
-        }
-        x = 0;
-        w = tex_desc.width;
-
-        UpdateImage(texture->GetImage(), m_data_mem_pool, m_device, m_queue, tex_desc.type, x, y, w, h, data);
-        return 1;
+        const u32 pitch = tex_desc.type == NVG_TEXTURE_RGBA ? tex_desc.width * 4 : tex_desc.width;
+        return m_uploads.Upload(texture->GetImage(), tex_desc.type, x, y, w, h, data, pitch) ? 1 : 0;
     }
 
     int DkRenderer::GetTextureSize(const DKNVGcontext &ctx, int image, int *w, int *h) {
@@ -483,43 +861,91 @@ namespace nvg {
     }
 
     const DKNVGtextureDescriptor *DkRenderer::GetTextureDescriptor(const DKNVGcontext &ctx, int id) {
-        for (auto it = m_textures.begin(); it != m_textures.end(); it++) {
-            if ((*it)->GetId() == id) {
-                return &(*it)->GetDescriptor();
-            }
+        Texture *texture = this->FindTexture(id);
+        if (texture == nullptr) {
+            return nullptr;
         }
 
-        return nullptr;
+        return &texture->GetDescriptor();
     }
 
     void DkRenderer::Flush(DKNVGcontext &ctx) {
-        if (ctx.ncalls > 0) {
-            /* Prepare dynamic command buffer. */
-            m_dyn_cmd_mem.begin(m_dyn_cmd_buf);
+        NVG_TRACE_ZONE("DkRenderer::Flush");
+        const u64 start_tick = armGetSystemTick();
+
+        /* Coalesce compatible calls before anything is recorded. */
+        const int index_count = this->MergeCalls(ctx);
+
+        const size_t vertex_size = ctx.nverts * sizeof(NVGvertex);
+        const size_t instance_size = (ctx.ninstances + 1) * sizeof(DKNVGinstance);
+        const size_t index_size = index_count * sizeof(u32); /* Worst case, 16-bit indices are used where possible. */
+        const size_t uniform_size = ctx.nuniforms * ctx.fragSize;
+        const size_t data_size = AlignUp(vertex_size, DK_UNIFORM_BUF_ALIGNMENT) + AlignUp(instance_size, DK_UNIFORM_BUF_ALIGNMENT) + AlignUp(index_size, DK_UNIFORM_BUF_ALIGNMENT) + AlignUp(sizeof(View), DK_UNIFORM_BUF_ALIGNMENT) + uniform_size;
+
+        /* Send off any pending texture copies ahead of the frame's draws. */
+        m_uploads.Submit();
+        m_stats.textureUploadBytes = m_uploads.GetStats().staged_bytes;
+        m_stats.textureUploadFailures = m_uploads.GetStats().failed;
+        m_uploads.ResetStats();
+
+        /* Grow the per-frame data area up front if this frame would not fit, so that recording never has to reallocate. */
+        bool record = ctx.ncalls > 0;
+        if (record && !m_dyn_cmd_mem.reserveData(m_data_mem_pool, data_size)) {
+            /* The pool is out of memory, nothing of this frame gets drawn. Make that show up in traces and stats. */
+            NVG_TRACE_ZONE("DkRenderer::DropFrame");
+            m_dropped_frames++;
+            record = false;
+        }
 
-            /* Update buffers with data. */
-            this->UpdateVertexBuffer(ctx.verts, ctx.nverts * sizeof(NVGvertex));
+        if (record) {
+            /* Prepare dynamic command buffer, waiting for the GPU to be done with this frame slot. */
+            {
+                NVG_TRACE_ZONE("DkRenderer::WaitForFrame");
+                m_dyn_cmd_mem.begin(m_dyn_cmd_buf);
+            }
+
+            /* The frame that last used this slot has now completed, along with all those before it. */
+            if (m_frame_index >= FrameCount) {
+                this->ReleaseRetiredTextures(m_frame_index - FrameCount + 1);
+            }
+
+            /* Write any new image descriptors before they are used. */
+            this->UpdateImageDescriptors();
+
+            /* Nothing is known about the GPU state left behind by other command lists. */
+            m_state.Begin(m_dyn_cmd_buf);
 
             /* Enable blending. */
             m_dyn_cmd_buf.bindColorState(dk::ColorState{}.setBlendEnable(0, true));
 
             /* Setup. */
-            m_dyn_cmd_buf.bindShaders(DkStageFlag_GraphicsMask, { m_vertex_shader, m_fragment_shader });
+            m_dyn_cmd_buf.bindShaders(DkStageFlag_Vertex, { m_vertex_shader });
             m_dyn_cmd_buf.bindVtxAttribState(VertexAttribState);
             m_dyn_cmd_buf.bindVtxBufferState(VertexBufferState);
-            m_dyn_cmd_buf.bindVtxBuffer(0, m_vertex_buffer->getGpuAddr(), m_vertex_buffer->getSize());
 
-            /* Push the view size to the uniform buffer and bind it. */
-            const auto view = View{glm::vec2{m_view_width, m_view_height}};
-            m_dyn_cmd_buf.pushConstants(m_view_uniform_buffer.getGpuAddr(), m_view_uniform_buffer.getSize(), 0, sizeof(view), &view);
-            m_dyn_cmd_buf.bindUniformBuffer(DkStage_Vertex, 0, m_view_uniform_buffer.getGpuAddr(), m_view_uniform_buffer.getSize());
+            /* Update buffers with data. */
+            this->ClipFillQuads(ctx);
+            this->UpdateVertexBuffer(ctx.verts, vertex_size);
+            this->UpdateInstanceBuffer(ctx);
+            if (index_count > 0) {
+                this->UpdateIndexBuffer(ctx, index_count);
+            }
+            this->UpdateViewUniforms();
+            this->UpdateFragmentUniforms(ctx.uniforms, uniform_size);
 
             /* Iterate over calls. */
             for (int i = 0; i < ctx.ncalls; i++) {
                 const DKNVGcall &call = ctx.calls[i];
 
+                /* Reject fragments outside of the scissor before they get shaded, calls scissored away entirely are dropped. */
+                const DkScissor scissor = this->GetScissorRect(ctx, call);
+                if (scissor.width == 0 || scissor.height == 0) {
+                    continue;
+                }
+                m_state.SetScissor(scissor);
+
                 /* Perform blending. */
-                m_dyn_cmd_buf.bindBlendStates(0, { dk::BlendState{}.setFactors(static_cast<DkBlendFactor>(call.blendFunc.srcRGB), static_cast<DkBlendFactor>(call.blendFunc.dstRGB), static_cast<DkBlendFactor>(call.blendFunc.srcAlpha), static_cast<DkBlendFactor>(call.blendFunc.dstRGB)) });
+                m_state.BindBlendState(dk::BlendState{}.setFactors(ConvertBlendFactor(call.blendFunc.srcRGB), ConvertBlendFactor(call.blendFunc.dstRGB), ConvertBlendFactor(call.blendFunc.srcAlpha), ConvertBlendFactor(call.blendFunc.dstAlpha)));
 
                 if (call.type == DKNVG_FILL) {
                     this->DrawFill(ctx, call);
@@ -532,7 +958,18 @@ namespace nvg {
                 }
             }
 
+            /* Leave the default depth stencil, colour write, rasterizer and scissor states behind for whoever renders next. */
+            this->BindDefaultStates();
+            m_state.SetScissor(DkScissor{0, 0, m_view_width, m_view_height});
+
             m_queue.submitCommands(m_dyn_cmd_mem.end(m_dyn_cmd_buf));
+            m_frame_index++;
+
+            const StateTracker::Stats &state_stats = m_state.GetStats();
+            m_stats.stateBinds = state_stats.emitted;
+            m_stats.stateBindsSkipped = state_stats.skipped;
+            m_stats.cmdBytes = m_dyn_cmd_mem.getCmdUsed();
+            m_stats.cmdPeakBytes = m_dyn_cmd_mem.getCmdPeak();
         }
 
         /* Reset calls. */
@@ -540,6 +977,36 @@ namespace nvg {
         ctx.npaths = 0;
         ctx.ncalls = 0;
         ctx.nuniforms = 0;
+        ctx.ninstances = 0;
+
+        /* Publish the figures of this frame and start counting the next one. */
+        m_stats.cmdCapacity = m_dyn_cmd_mem.getCmdSize();
+        m_stats.droppedFrames = m_dropped_frames;
+        m_stats.flushTime = armTicksToNs(armGetSystemTick() - start_tick) / 1000000.0f;
+        m_last_stats = m_stats;
+        m_stats = {};
+    }
+
+    void DkRenderer::GetFrameStats(NVGframeStats &stats) const {
+        stats.draws = m_last_stats.draws;
+        stats.stateBinds = m_last_stats.stateBinds;
+        stats.stateBindsSkipped = m_last_stats.stateBindsSkipped;
+        stats.cmdBytes = m_last_stats.cmdBytes;
+        stats.cmdCapacity = m_last_stats.cmdCapacity;
+        stats.cmdPeakBytes = m_last_stats.cmdPeakBytes;
+        stats.vertexBytes = m_last_stats.vertexBytes;
+        stats.indexBytes = m_last_stats.indexBytes;
+        stats.uniformBytes = m_last_stats.uniformBytes;
+        stats.textureUploadBytes = m_last_stats.textureUploadBytes;
+        stats.textureUploadFailures = m_last_stats.textureUploadFailures;
+        stats.descriptorAcquires = m_last_stats.descriptorAcquires;
+        stats.descriptorMisses = m_last_stats.descriptorMisses;
+        stats.droppedFrames = m_last_stats.droppedFrames;
+        stats.flushTime = m_last_stats.flushTime;
+    }
+
+    const StateTracker::Stats &DkRenderer::GetStateStats() const {
+        return m_state.GetStats();
     }
 
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 **   CApplication.cpp: Wrapper class containing common application boilerplate
 */
 #include "CApplication.h"
+#include "nanovg_trace.h"
 
 CApplication::CApplication()
 {
@@ -26,6 +27,9 @@ void CApplication::run()
 
     for (;;)
     {
+        // One zone per iteration, so that each frame shows up on its own
+        NVG_TRACE_ZONE("CApplication::run");
+
         u32 msg = 0;
         Result rc = appletGetMessage(&msg);
         if (R_SUCCEEDED(rc))
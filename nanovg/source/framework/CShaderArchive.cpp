@@ -0,0 +1,88 @@
+/*
+** Sample Framework for deko3d Applications
+**   CShaderArchive.cpp: Utility class for loading a packed set of shaders from the filesystem
+*/
+#include "CShaderArchive.h"
+
+static_assert(DKSH_ARCHIVE_CODE_ALIGNMENT == DK_SHADER_CODE_ALIGNMENT, "Archive code alignment doesn't match deko3d's");
+
+bool CShaderArchive::load(CMemPool& pool, const char* path)
+{
+    FILE* f;
+    DkshArchiveHeader hdr;
+    uint8_t* ctrlmem;
+    const DkshArchiveEntry* entries;
+    uint64_t indexEnd;
+
+    m_shaders.clear();
+    m_codemem.destroy();
+
+    f = fopen(path, "rb");
+    if (!f) return false;
+
+    if (!fread(&hdr, sizeof(hdr), 1, f))
+        goto _fail0;
+
+    if (hdr.magic != DKSH_ARCHIVE_MAGIC)
+        goto _fail0;
+
+    // Control sections must lie past the index, as only that part of ctrlmem is read in
+    indexEnd = sizeof(hdr) + (uint64_t)hdr.num_shaders * sizeof(DkshArchiveEntry);
+    if (hdr.code_off < indexEnd)
+        goto _fail0;
+
+    // The index and control sections are only needed until the shaders are initialized
+    ctrlmem = (uint8_t*)malloc(hdr.code_off);
+    if (!ctrlmem)
+        goto _fail0;
+
+    if (!fread(ctrlmem + sizeof(hdr), hdr.code_off - sizeof(hdr), 1, f))
+        goto _fail1;
+
+    m_codemem = pool.allocate(hdr.code_sz, DK_SHADER_CODE_ALIGNMENT);
+    if (!m_codemem)
+        goto _fail1;
+
+    if (!fread(m_codemem.getCpuAddr(), hdr.code_sz, 1, f))
+        goto _fail2;
+
+    entries = (const DkshArchiveEntry*)(ctrlmem + sizeof(hdr));
+    m_shaders.resize(hdr.num_shaders);
+    for (uint32_t i = 0; i < hdr.num_shaders; i++)
+    {
+        const DkshArchiveEntry& entry = entries[i];
+        if (entry.control_off < indexEnd || entry.control_off > hdr.code_off || entry.control_sz > hdr.code_off - entry.control_off)
+            goto _fail2;
+        if (entry.code_off > hdr.code_sz || entry.code_sz > hdr.code_sz - entry.code_off)
+            goto _fail2;
+
+        memcpy(m_shaders[i].name, entry.name, sizeof(entry.name));
+        m_shaders[i].name[DKSH_ARCHIVE_NAME_LEN-1] = 0;
+
+        dk::ShaderMaker{m_codemem.getMemBlock(), m_codemem.getOffset() + entry.code_off}
+            .setControl(ctrlmem + entry.control_off)
+            .setProgramId(0)
+            .initialize(m_shaders[i].shader);
+    }
+
+    free(ctrlmem);
+    fclose(f);
+    return true;
+
+_fail2:
+    m_shaders.clear();
+    m_codemem.destroy();
+_fail1:
+    free(ctrlmem);
+_fail0:
+    fclose(f);
+    return false;
+}
+
+const dk::Shader* CShaderArchive::find(const char* name) const
+{
+    for (const Entry& entry : m_shaders)
+        if (strcmp(entry.name, name) == 0)
+            return &entry.shader;
+    return nullptr;
+}
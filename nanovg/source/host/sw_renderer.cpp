@@ -0,0 +1,470 @@
+#include "sw_renderer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <math.h>
+#include <string.h>
+#include <thread>
+
+namespace nvg {
+
+    namespace {
+
+        /* Edge function, positive when p lies to the right of a->b in y-down coordinates. */
+        template<typename V>
+        double Edge(const V &a, const V &b, double px, double py) {
+            return (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+        }
+
+        /* Pixels exactly on an edge belong to only one of the two triangles sharing it. */
+        template<typename V>
+        bool IsInside(double w, const V &a, const V &b) {
+            if (w != 0.0) {
+                return w > 0.0;
+            }
+
+            const double dx = b.x - a.x, dy = b.y - a.y;
+            return dy < 0.0 || (dy == 0.0 && dx > 0.0);
+        }
+
+        /* Snaps positions to the 1/256th of a pixel, so that shared edges are evaluated identically. */
+        double SnapSubpixel(float value) {
+            return round(static_cast<double>(value) * 256.0) / 256.0;
+        }
+
+        float Clamp(float value, float min, float max) {
+            return value < min ? min : (value > max ? max : value);
+        }
+
+        float SdRoundRect(float x, float y, float ext_x, float ext_y, float rad) {
+            const float dx = fabsf(x) - (ext_x - rad);
+            const float dy = fabsf(y) - (ext_y - rad);
+            const float mx = std::max(dx, 0.0f), my = std::max(dy, 0.0f);
+            return std::min(std::max(dx, dy), 0.0f) + sqrtf(mx * mx + my * my) - rad;
+        }
+
+        /* Matrices are stored as three vec4 columns, see DKNVGfragUniforms. */
+        void TransformPoint(const float *m, float x, float y, float *out_x, float *out_y) {
+            *out_x = m[0] * x + m[4] * y + m[8];
+            *out_y = m[1] * x + m[5] * y + m[9];
+        }
+
+        void BlendFactor(int factor, const float *src, const float *dst, float *out) {
+            for (int c = 0; c < 4; c++) {
+                switch (factor) {
+                    case NVG_ZERO:                out[c] = 0.0f; break;
+                    case NVG_ONE:                 out[c] = 1.0f; break;
+                    case NVG_SRC_COLOR:           out[c] = src[c]; break;
+                    case NVG_ONE_MINUS_SRC_COLOR: out[c] = 1.0f - src[c]; break;
+                    case NVG_DST_COLOR:           out[c] = dst[c]; break;
+                    case NVG_ONE_MINUS_DST_COLOR: out[c] = 1.0f - dst[c]; break;
+                    case NVG_SRC_ALPHA:           out[c] = src[3]; break;
+                    case NVG_ONE_MINUS_SRC_ALPHA: out[c] = 1.0f - src[3]; break;
+                    case NVG_DST_ALPHA:           out[c] = dst[3]; break;
+                    case NVG_ONE_MINUS_DST_ALPHA: out[c] = 1.0f - dst[3]; break;
+                    case NVG_SRC_ALPHA_SATURATE:  out[c] = c < 3 ? std::min(src[3], 1.0f - dst[3]) : 1.0f; break;
+                    default:                      out[c] = 0.0f; break;
+                }
+            }
+        }
+
+    }
+
+    SwRenderer::SwRenderer(int width, int height, unsigned thread_count) :
+        m_width(width), m_height(height), m_thread_count(thread_count), m_color(width * height * 4), m_stencil(width * height)
+    {
+        if (m_thread_count == 0) {
+            m_thread_count = std::max(1u, std::thread::hardware_concurrency());
+        }
+    }
+
+    void SwRenderer::AddPasses(const DKNVGcall &call, int frag_size) {
+        const Texture *texture = call.image != 0 ? this->FindTexture(call.image) : nullptr;
+        const DKNVGinstance *instance = nullptr;
+        const auto uniforms = [&](int offset) {
+            return reinterpret_cast<const DKNVGfragUniforms *>(this->GetUniforms().data() + offset);
+        };
+        const auto add = [&](PassType type, const Texture *pass_texture, int uniform_offset, int index_offset, int index_count) {
+            if (index_count > 0) {
+                m_passes.push_back(Pass{type, m_stroke_stencil_ref, pass_texture, call.blendFunc, uniforms(uniform_offset), index_offset, index_count, instance});
+            }
+        };
+
+        /* Instances are drawn one after the other, as the GPU does within an instanced draw. */
+        const int instance_count = std::max(call.instanceCount, 1);
+        const auto set_instance = [&](int i) {
+            instance = call.instanceCount > 0 ? &this->GetInstances()[call.instanceOffset + i] : nullptr;
+        };
+
+        if (call.type == DKNVG_FILL) {
+            /* The cover quad is a triangle strip, turn it into a list with the same winding as the GPU would. */
+            const int quad_offset = m_indices.size();
+            const uint32_t quad = call.triangleOffset;
+            m_indices.insert(m_indices.end(), { quad, quad + 1, quad + 2, quad + 2, quad + 1, quad + 3 });
+
+            for (int i = 0; i < instance_count; i++) {
+                set_instance(i);
+                add(PassType_FillStencil, nullptr, call.uniformOffset, call.indexOffset, call.indexCount);
+                if (m_flags & NVG_ANTIALIAS) {
+                    add(PassType_FillFringe, texture, call.uniformOffset + frag_size, call.fringeIndexOffset, call.fringeIndexCount);
+                }
+                add(PassType_FillCover, texture, call.uniformOffset + frag_size, quad_offset, 6);
+            }
+        } else if (call.type == DKNVG_CONVEXFILL) {
+            for (int i = 0; i < instance_count; i++) {
+                set_instance(i);
+                add(PassType_Plain, texture, call.uniformOffset, call.indexOffset, call.indexCount);
+            }
+        } else if (call.type == DKNVG_STROKE) {
+            if ((m_flags & NVG_STENCIL_STROKES) && !call.simpleStroke) {
+                /* Same rotation of stroke values as DkRenderer, wrapping clears the stroke bits of the whole target. */
+                if (m_stroke_stencil_ref == MaxStrokeStencilRef) {
+                    m_passes.push_back(Pass{PassType_StrokeWrap, 0, nullptr, call.blendFunc, nullptr, 0, 0, nullptr});
+                    m_stroke_stencil_ref = 0;
+                }
+                m_stroke_stencil_ref++;
+
+                add(PassType_StrokeBase, texture, call.uniformOffset + frag_size, call.indexOffset, call.indexCount);
+                add(PassType_StrokeFringe, texture, call.uniformOffset, call.indexOffset, call.indexCount);
+            } else {
+                add(PassType_Plain, texture, call.uniformOffset, call.indexOffset, call.indexCount);
+            }
+        } else if (call.type == DKNVG_TRIANGLES) {
+            const int offset = m_indices.size();
+            for (int i = 0; i < call.triangleCount; i++) {
+                m_indices.push_back(call.triangleOffset + i);
+            }
+            add(PassType_Plain, texture, call.uniformOffset, offset, call.triangleCount);
+        }
+    }
+
+    SwRenderer::Vertex SwRenderer::MoveVertex(const Vertex &vertex, const DKNVGinstance &instance) const {
+        /* Mirrors fill_vsh.glsl, the paint keeps being evaluated at the position before the transform. */
+        const float *t = instance.xform;
+        const float px = t[0] * vertex.lx + t[2] * vertex.ly + t[4];
+        const float py = t[1] * vertex.lx + t[3] * vertex.ly + t[5];
+        return Vertex{SnapSubpixel(px * m_scale_x), SnapSubpixel(py * m_scale_y), vertex.u, vertex.v, px, py, vertex.lx, vertex.ly};
+    }
+
+    void SwRenderer::Sample(const Texture &texture, float u, float v, float *out) {
+        const DKNVGtextureDescriptor &desc = texture.descriptor;
+        const int w = desc.width, h = desc.height;
+
+        /* Mipmaps are not generated, the base level is always sampled. */
+        const auto wrap = [](int i, int size, bool repeat) {
+            return repeat ? ((i % size) + size) % size : std::min(std::max(i, 0), size - 1);
+        };
+        const auto fetch = [&](int x, int y, float weight, float *acc) {
+            x = wrap(x, w, desc.flags & NVG_IMAGE_REPEATX);
+            y = wrap(y, h, desc.flags & NVG_IMAGE_REPEATY);
+            if (desc.type == NVG_TEXTURE_RGBA) {
+                const uint8_t *texel = &texture.data[(y * w + x) * 4];
+                for (int c = 0; c < 4; c++) {
+                    acc[c] += weight * (texel[c] / 255.0f);
+                }
+            } else {
+                /* Single channel images read as (r, 0, 0, 1). */
+                acc[0] += weight * (texture.data[y * w + x] / 255.0f);
+                acc[3] += weight;
+            }
+        };
+
+        out[0] = out[1] = out[2] = out[3] = 0.0f;
+        if (desc.flags & NVG_IMAGE_NEAREST) {
+            fetch(static_cast<int>(floorf(u * w)), static_cast<int>(floorf(v * h)), 1.0f, out);
+        } else {
+            const float x = u * w - 0.5f, y = v * h - 0.5f;
+            const int x0 = static_cast<int>(floorf(x)), y0 = static_cast<int>(floorf(y));
+            const float fx = x - x0, fy = y - y0;
+            fetch(x0,     y0,     (1.0f - fx) * (1.0f - fy), out);
+            fetch(x0 + 1, y0,     fx * (1.0f - fy),          out);
+            fetch(x0,     y0 + 1, (1.0f - fx) * fy,          out);
+            fetch(x0 + 1, y0 + 1, fx * fy,                   out);
+        }
+    }
+
+    bool SwRenderer::Shade(const Pass &pass, float u, float v, float px, float py, float lx, float ly, float *out) {
+        /* Mirrors the fill_*_fsh.glsl shaders, picking the anti-aliased ones when enabled. */
+        const DKNVGfragUniforms &frag = *pass.uniforms;
+
+        float sx, sy;
+        TransformPoint(frag.scissorMat, px, py, &sx, &sy);
+        sx = 0.5f - (fabsf(sx) - frag.scissorExt[0]) * frag.scissorScale[0];
+        sy = 0.5f - (fabsf(sy) - frag.scissorExt[1]) * frag.scissorScale[1];
+        const float scissor = Clamp(sx, 0.0f, 1.0f) * Clamp(sy, 0.0f, 1.0f);
+
+        /* Shapes have their own coverage instead of the stroke mask, u and v aren't texture coordinates for them. */
+        float stroke_alpha = 1.0f;
+        if ((m_flags & NVG_ANTIALIAS) && frag.type != NSVG_SHADER_FILLSHAPE) {
+            stroke_alpha = std::min(1.0f, (1.0f - fabsf(u * 2.0f - 1.0f)) * frag.strokeMult) * std::min(1.0f, v);
+            if (stroke_alpha < frag.strokeThr) {
+                return false;
+            }
+        }
+
+        const float inner[4] = { frag.innerCol.r, frag.innerCol.g, frag.innerCol.b, frag.innerCol.a };
+        const float outer[4] = { frag.outerCol.r, frag.outerCol.g, frag.outerCol.b, frag.outerCol.a };
+        float color[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        float factor = 1.0f;
+
+        if (frag.type == NSVG_SHADER_FILLGRAD) {
+            float x, y;
+            TransformPoint(frag.paintMat, lx, ly, &x, &y);
+            const float d = Clamp((SdRoundRect(x, y, frag.extent[0], frag.extent[1], frag.radius) + frag.feather * 0.5f) / frag.feather, 0.0f, 1.0f);
+            for (int c = 0; c < 4; c++) {
+                color[c] = inner[c] + (outer[c] - inner[c]) * d;
+            }
+            factor = stroke_alpha * scissor;
+        } else if (frag.type == NSVG_SHADER_FILLSHAPE) {
+            /* The shape comes from the distance to its edge, u and v being the position relative to its centre. */
+            const float distance = SdRoundRect(u, v, frag.shapeExt[0], frag.shapeExt[1], frag.shapeRadius);
+            const float shape_alpha = (m_flags & NVG_ANTIALIAS) ? Clamp(0.5f - distance * frag.shapeScale, 0.0f, 1.0f) : (distance <= 0.0f ? 1.0f : 0.0f);
+
+            float x, y;
+            TransformPoint(frag.paintMat, lx, ly, &x, &y);
+            const float d = Clamp((SdRoundRect(x, y, frag.extent[0], frag.extent[1], frag.radius) + frag.feather * 0.5f) / frag.feather, 0.0f, 1.0f);
+            for (int c = 0; c < 4; c++) {
+                color[c] = inner[c] + (outer[c] - inner[c]) * d;
+            }
+            factor = shape_alpha * scissor;
+        } else if (frag.type == NSVG_SHADER_FILLIMG || frag.type == NSVG_SHADER_IMG) {
+            if (frag.type == NSVG_SHADER_FILLIMG) {
+                TransformPoint(frag.paintMat, lx, ly, &u, &v);
+                u /= frag.extent[0];
+                v /= frag.extent[1];
+                factor = stroke_alpha * scissor;
+            } else {
+                factor = scissor;
+            }
+
+            if (pass.texture != nullptr) {
+                this->Sample(*pass.texture, u, v, color);
+            }
+            if (frag.texType == 1) {
+                color[0] *= color[3];
+                color[1] *= color[3];
+                color[2] *= color[3];
+            } else if (frag.texType == 2) {
+                color[1] = color[2] = color[3] = color[0];
+            }
+            for (int c = 0; c < 4; c++) {
+                color[c] *= inner[c];
+            }
+        } else if (frag.type == NSVG_SHADER_SIMPLE) {
+            color[0] = color[1] = color[2] = color[3] = 1.0f;
+        }
+
+        /* Paints are tinted by their instance, only the stencil doesn't write colours to tint. */
+        if (pass.instance != nullptr && frag.type != NSVG_SHADER_SIMPLE) {
+            for (int c = 0; c < 4; c++) {
+                color[c] *= pass.instance->tint.rgba[c];
+            }
+        }
+
+        for (int c = 0; c < 4; c++) {
+            out[c] = color[c] * factor;
+        }
+        return true;
+    }
+
+    void SwRenderer::RasterizePass(const Pass &pass, int x0, int y0, int x1, int y1) {
+        /* Only the stencil pass of fills draws back faces, like the GPU every other pass culls them. */
+        const bool cull = pass.type != PassType_FillStencil;
+        const bool write_color = pass.type != PassType_FillStencil;
+        const uint8_t stroke_ref = pass.stencil_ref << StrokeStencilShift;
+
+        if (pass.type == PassType_StrokeWrap) {
+            for (int y = y0; y < y1; y++) {
+                for (int x = x0; x < x1; x++) {
+                    m_stencil[y * m_width + x] &= ~StrokeStencilMask;
+                }
+            }
+            return;
+        }
+
+        for (int i = 0; i + 2 < pass.index_count; i += 3) {
+            const Vertex *a = &m_vertices[m_indices[pass.index_offset + i]];
+            const Vertex *b = &m_vertices[m_indices[pass.index_offset + i + 1]];
+            const Vertex *c = &m_vertices[m_indices[pass.index_offset + i + 2]];
+
+            Vertex moved[3];
+            if (pass.instance != nullptr) {
+                moved[0] = this->MoveVertex(*a, *pass.instance);
+                moved[1] = this->MoveVertex(*b, *pass.instance);
+                moved[2] = this->MoveVertex(*c, *pass.instance);
+                a = &moved[0];
+                b = &moved[1];
+                c = &moved[2];
+            }
+
+            /* Counter-clockwise in normalized device coordinates, hence clockwise with y pointing down. */
+            double area = Edge(*a, *b, c->x, c->y);
+            const bool front = area < 0.0;
+            if (area == 0.0 || (cull && !front)) {
+                continue;
+            }
+            if (area < 0.0) {
+                std::swap(b, c);
+                area = -area;
+            }
+
+            const int min_x = std::max(x0, static_cast<int>(floor(std::min({a->x, b->x, c->x}))));
+            const int min_y = std::max(y0, static_cast<int>(floor(std::min({a->y, b->y, c->y}))));
+            const int max_x = std::min(x1, static_cast<int>(ceil(std::max({a->x, b->x, c->x}))));
+            const int max_y = std::min(y1, static_cast<int>(ceil(std::max({a->y, b->y, c->y}))));
+
+            for (int y = min_y; y < max_y; y++) {
+                const double cy = y + 0.5;
+                for (int x = min_x; x < max_x; x++) {
+                    const double cx = x + 0.5;
+                    const double w0 = Edge(*b, *c, cx, cy);
+                    const double w1 = Edge(*c, *a, cx, cy);
+                    const double w2 = Edge(*a, *b, cx, cy);
+                    if (!IsInside(w0, *b, *c) || !IsInside(w1, *c, *a) || !IsInside(w2, *a, *b)) {
+                        continue;
+                    }
+
+                    uint8_t &stencil = m_stencil[y * m_width + x];
+
+                    /* Stencil test, failing fragments only ever get their stencil zeroed. */
+                    bool pass_test = true;
+                    switch (pass.type) {
+                        case PassType_FillFringe:
+                            pass_test = (stencil & FillStencilMask) == 0;
+                            break;
+                        case PassType_FillCover:
+                            pass_test = (stencil & FillStencilMask) != 0;
+                            break;
+                        case PassType_StrokeBase:
+                        case PassType_StrokeFringe:
+                            pass_test = (stencil & StrokeStencilMask) != stroke_ref;
+                            break;
+                        default:
+                            break;
+                    }
+                    if (!pass_test) {
+                        continue;
+                    }
+
+                    if (pass.type == PassType_FillStencil) {
+                        stencil = (stencil & StrokeStencilMask) | ((stencil + (front ? 1 : -1)) & FillStencilMask);
+                        continue;
+                    }
+
+                    const float l0 = w0 / area, l1 = w1 / area, l2 = w2 / area;
+                    float src[4];
+                    if (!this->Shade(pass, a->u * l0 + b->u * l1 + c->u * l2, a->v * l0 + b->v * l1 + c->v * l2,
+                                     a->px * l0 + b->px * l1 + c->px * l2, a->py * l0 + b->py * l1 + c->py * l2,
+                                     a->lx * l0 + b->lx * l1 + c->lx * l2, a->ly * l0 + b->ly * l1 + c->ly * l2, src)) {
+                        continue;
+                    }
+
+                    if (pass.type == PassType_FillCover) {
+                        stencil &= StrokeStencilMask;
+                    } else if (pass.type == PassType_StrokeBase) {
+                        stencil = (stencil & FillStencilMask) | stroke_ref;
+                    }
+
+                    if (write_color) {
+                        uint8_t *pixel = &m_color[(y * m_width + x) * 4];
+                        float dst[4], src_rgb[4], dst_rgb[4], src_alpha[4], dst_alpha[4];
+                        for (int ch = 0; ch < 4; ch++) {
+                            dst[ch] = pixel[ch] / 255.0f;
+                        }
+
+                        BlendFactor(pass.blend.srcRGB, src, dst, src_rgb);
+                        BlendFactor(pass.blend.dstRGB, src, dst, dst_rgb);
+                        BlendFactor(pass.blend.srcAlpha, src, dst, src_alpha);
+                        BlendFactor(pass.blend.dstAlpha, src, dst, dst_alpha);
+                        for (int ch = 0; ch < 4; ch++) {
+                            const float value = ch < 3 ? src[ch] * src_rgb[ch] + dst[ch] * dst_rgb[ch] : src[ch] * src_alpha[ch] + dst[ch] * dst_alpha[ch];
+                            pixel[ch] = static_cast<uint8_t>(Clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    void SwRenderer::RasterizeTile(int tile_x, int tile_y) {
+        const int x0 = tile_x * TileSize, y0 = tile_y * TileSize;
+        const int x1 = std::min(x0 + TileSize, m_width), y1 = std::min(y0 + TileSize, m_height);
+
+        /* Tiles are independent of each other, but passes have to be applied in order within one. */
+        for (const Pass &pass : m_passes) {
+            this->RasterizePass(pass, x0, y0, x1, y1);
+        }
+    }
+
+    void SwRenderer::Flush(DKNVGcontext &ctx) {
+        m_flags = ctx.flags;
+        const int frag_size = ctx.fragSize;
+        m_scale_x = ctx.view[0] > 0.0f ? m_width / ctx.view[0] : 1.0f;
+        m_scale_y = ctx.view[1] > 0.0f ? m_height / ctx.view[1] : 1.0f;
+
+        /* Let the null renderer batch the frame and keep a copy of it. */
+        NullRenderer::Flush(ctx);
+
+        /* Vertex stage, positions are mapped from the view to the framebuffer. */
+        const auto &vertices = this->GetVertices();
+        m_vertices.resize(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++) {
+            const NVGvertex &in = vertices[i];
+            m_vertices[i] = Vertex{SnapSubpixel(in.x * m_scale_x), SnapSubpixel(in.y * m_scale_y), in.u, in.v, in.x, in.y, in.x, in.y};
+        }
+
+        m_indices = this->GetIndices();
+        m_passes.clear();
+        for (const DKNVGcall &call : this->GetCalls()) {
+            this->AddPasses(call, frag_size);
+        }
+
+        const int tiles_x = (m_width + TileSize - 1) / TileSize;
+        const int tile_count = tiles_x * ((m_height + TileSize - 1) / TileSize);
+        std::atomic<int> next_tile = 0;
+
+        const auto worker = [&]() {
+            for (int tile = next_tile++; tile < tile_count; tile = next_tile++) {
+                this->RasterizeTile(tile % tiles_x, tile / tiles_x);
+            }
+        };
+
+        /* The calling thread takes its share of tiles as well. */
+        std::vector<std::thread> threads;
+        for (unsigned i = 1; i < std::min<unsigned>(m_thread_count, tile_count); i++) {
+            threads.emplace_back(worker);
+        }
+        worker();
+
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+    }
+
+    void SwRenderer::Clear(NVGcolor color) {
+        const uint8_t pixel[4] = {
+            static_cast<uint8_t>(Clamp(color.r * color.a, 0.0f, 1.0f) * 255.0f + 0.5f),
+            static_cast<uint8_t>(Clamp(color.g * color.a, 0.0f, 1.0f) * 255.0f + 0.5f),
+            static_cast<uint8_t>(Clamp(color.b * color.a, 0.0f, 1.0f) * 255.0f + 0.5f),
+            static_cast<uint8_t>(Clamp(color.a, 0.0f, 1.0f) * 255.0f + 0.5f),
+        };
+
+        for (size_t i = 0; i < m_color.size(); i += 4) {
+            memcpy(&m_color[i], pixel, sizeof(pixel));
+        }
+        std::fill(m_stencil.begin(), m_stencil.end(), 0);
+    }
+
+    int SwRenderer::GetWidth() const {
+        return m_width;
+    }
+
+    int SwRenderer::GetHeight() const {
+        return m_height;
+    }
+
+    const uint8_t *SwRenderer::GetPixels() const {
+        return m_color.data();
+    }
+
+}
@@ -22,7 +22,9 @@
 #include <memory.h>
 
 #include "nanovg.h"
+#include "nanovg_trace.h"
 #define FONTSTASH_IMPLEMENTATION
+#define FONS_TRACE_ZONE(name) NVG_TRACE_ZONE(name)
 #include "fontstash.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -43,6 +45,7 @@
 #define NVG_INIT_PATHS_SIZE 16
 #define NVG_INIT_VERTS_SIZE 256
 #define NVG_MAX_STATES 32
+#define NVG_MAX_TRIANGULATE_VERTS 64	// Concave fills with more vertices than this go through the stencil.
 
 #define NVG_KAPPA90 0.5522847493f	// Length proportional to radius of a cubic bezier handle for 90deg arcs.
 
@@ -109,11 +112,23 @@ struct NVGpathCache {
 };
 typedef struct NVGpathCache NVGpathCache;
 
+// Kept while the path is a single rectangle, rounded rectangle or circle, for back-ends able to
+// fill it without flattening. Sizes are in the local space of the transform it was added with.
+struct NVGshape {
+	int ncommands;	// Path length right after the shape was added, 0 if the path is anything else.
+	float xform[6];
+	float cx, cy;
+	float hw, hh;
+	float r;
+};
+typedef struct NVGshape NVGshape;
+
 struct NVGcontext {
 	NVGparams params;
 	float* commands;
 	int ccommands;
 	int ncommands;
+	NVGshape shape;
 	float commandx, commandy;
 	NVGstate states[NVG_MAX_STATES];
 	int nstates;
@@ -129,6 +144,10 @@ struct NVGcontext {
 	int fillTriCount;
 	int strokeTriCount;
 	int textTriCount;
+	NVGinstance* instances;
+	int cinstances;
+	NVGvertex* instanceVerts;	// Untransformed copy of the path, for back-ends without instancing.
+	int cinstanceVerts;
 };
 
 static float nvg__sqrtf(float a) { return sqrtf(a); }
@@ -340,12 +359,20 @@ NVGparams* nvgInternalParams(NVGcontext* ctx)
     return &ctx->params;
 }
 
+const unsigned char* nvgInternalFontAtlas(NVGcontext* ctx, int* image, int* w, int* h)
+{
+	*image = ctx->fontImages[ctx->fontImageIdx];
+	return fonsGetTextureData(ctx->fs, w, h);
+}
+
 void nvgDeleteInternal(NVGcontext* ctx)
 {
 	int i;
 	if (ctx == NULL) return;
 	if (ctx->commands != NULL) free(ctx->commands);
 	if (ctx->cache != NULL) nvg__deletePathCache(ctx->cache);
+	if (ctx->instances != NULL) free(ctx->instances);
+	if (ctx->instanceVerts != NULL) free(ctx->instanceVerts);
 
 	if (ctx->fs)
 		fonsDeleteInternal(ctx->fs);
@@ -365,6 +392,8 @@ void nvgDeleteInternal(NVGcontext* ctx)
 
 void nvgBeginFrame(NVGcontext* ctx, float windowWidth, float windowHeight, float devicePixelRatio)
 {
+	NVG_TRACE_ZONE("nvgBeginFrame");
+
 /*	printf("Tris: draws:%d  fill:%d  stroke:%d  text:%d  TOT:%d\n",
 		ctx->drawCallCount, ctx->fillTriCount, ctx->strokeTriCount, ctx->textTriCount,
 		ctx->fillTriCount+ctx->strokeTriCount+ctx->textTriCount);*/
@@ -388,8 +417,14 @@ void nvgCancelFrame(NVGcontext* ctx)
 	ctx->params.renderCancel(ctx->params.userPtr);
 }
 
+static void nvg__flushTextTexture(NVGcontext* ctx);
+
 void nvgEndFrame(NVGcontext* ctx)
 {
+	NVG_TRACE_ZONE("nvgEndFrame");
+
+	if (ctx->params.deferredTextureUpdates)
+		nvg__flushTextTexture(ctx);
 	ctx->params.renderFlush(ctx->params.userPtr);
 	if (ctx->fontImageIdx != 0) {
 		int fontImage = ctx->fontImages[ctx->fontImageIdx];
@@ -418,6 +453,18 @@ void nvgEndFrame(NVGcontext* ctx)
 	}
 }
 
+void nvgGetFrameStats(NVGcontext* ctx, NVGframeStats* stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	stats->drawCallCount = ctx->drawCallCount;
+	stats->fillTriCount = ctx->fillTriCount;
+	stats->strokeTriCount = ctx->strokeTriCount;
+	stats->textTriCount = ctx->textTriCount;
+
+	if (ctx->params.renderGetStats != NULL)
+		ctx->params.renderGetStats(ctx->params.userPtr, stats);
+}
+
 NVGcolor nvgRGB(unsigned char r, unsigned char g, unsigned char b)
 {
 	return nvgRGBA(r,g,b,255);
@@ -824,6 +871,7 @@ int nvgCreateImageRGBA(NVGcontext* ctx, int w, int h, int imageFlags, const unsi
 
 void nvgUpdateImage(NVGcontext* ctx, int image, const unsigned char* data)
 {
+	NVG_TRACE_ZONE("nvgUpdateImage");
 	int w, h;
 	ctx->params.renderGetTextureSize(ctx->params.userPtr, image, &w, &h);
 	ctx->params.renderUpdateTexture(ctx->params.userPtr, image, 0,0, w,h, data);
@@ -1336,6 +1384,8 @@ static void nvg__flattenPaths(NVGcontext* ctx)
 	if (cache->npaths > 0)
 		return;
 
+	NVG_TRACE_ZONE("nvg__flattenPaths");
+
 	// Flatten
 	i = 0;
 	while (i < ctx->ncommands) {
@@ -1647,6 +1697,49 @@ static NVGvertex* nvg__roundCapEnd(NVGvertex* dst, NVGpoint* p,
 }
 
 
+// Checks whether the stroke of a path, as expanded with half width w, is free of overlaps.
+// That is the case for an open path turning less than half a circle, or a closed one turning
+// exactly once, always to the same side, as long as the inner side of every segment is longer
+// than what its joins take away from it.
+static int nvg__isSimpleStroke(NVGpath* path, NVGpoint* pts, float w)
+{
+	float ext0 = 0.0f, turn = 0.0f, side = 0.0f;
+	int i, n = path->count;
+
+	if (n < 2)
+		return 0;
+
+	// Closed paths come back to their first join, to check the last segment against it.
+	for (i = 0; i < (path->closed ? n+1 : n); i++) {
+		NVGpoint* p0 = &pts[(i+n-1) % n];
+		NVGpoint* p1 = &pts[i % n];
+		float ext = 0.0f;
+		if (path->closed || (i > 0 && i < n-1)) {
+			float cross = nvg__cross(p0->dx, p0->dy, p1->dx, p1->dy);
+			float dot = p0->dx*p1->dx + p0->dy*p1->dy;
+			if (nvg__absf(cross) > 1e-6f) {
+				if (side * cross < 0.0f)
+					return 0;
+				side = cross;
+			}
+			// Nearly reversing joins and inner bevels fold the stroke back onto itself.
+			if (dot < -0.99f || (p1->flags & NVG_PR_INNERBEVEL))
+				return 0;
+			// The inner miter point lies this far along both segments meeting at the join.
+			ext = w * nvg__absf(cross) / (1.0f + dot);
+			if (i < n)
+				turn += nvg__atan2f(nvg__absf(cross), dot);
+		}
+		if (i > 0 && ext0 + ext > p0->len)
+			return 0;
+		ext0 = ext;
+	}
+
+	if (path->closed)
+		return turn < NVG_PI*3;
+	return turn < NVG_PI;
+}
+
 static void nvg__calculateJoins(NVGcontext* ctx, float w, int lineJoin, float miterLimit)
 {
 	NVGpathCache* cache = ctx->cache;
@@ -1719,6 +1812,7 @@ static void nvg__calculateJoins(NVGcontext* ctx, float w, int lineJoin, float mi
 
 static int nvg__expandStroke(NVGcontext* ctx, float w, float fringe, int lineCap, int lineJoin, float miterLimit)
 {
+	NVG_TRACE_ZONE("nvg__expandStroke");
 	NVGpathCache* cache = ctx->cache;
 	NVGvertex* verts;
 	NVGvertex* dst;
@@ -1834,6 +1928,7 @@ static int nvg__expandStroke(NVGcontext* ctx, float w, float fringe, int lineCap
 		}
 
 		path->nstroke = (int)(dst - verts);
+		path->simpleStroke = nvg__isSimpleStroke(path, pts, w);
 
 		verts = dst;
 	}
@@ -1841,12 +1936,105 @@ static int nvg__expandStroke(NVGcontext* ctx, float w, float fringe, int lineCap
 	return 1;
 }
 
+static int nvg__segmentsTouch(const NVGvertex* a, const NVGvertex* b, const NVGvertex* c, const NVGvertex* d)
+{
+	float a0 = nvg__triarea2(a->x,a->y, b->x,b->y, c->x,c->y);
+	float a1 = nvg__triarea2(a->x,a->y, b->x,b->y, d->x,d->y);
+	float a2 = nvg__triarea2(c->x,c->y, d->x,d->y, a->x,a->y);
+	float a3 = nvg__triarea2(c->x,c->y, d->x,d->y, b->x,b->y);
+	// Segments on the same line only touch if they overlap.
+	if (a0 == 0.0f && a1 == 0.0f)
+		return nvg__minf(a->x, b->x) <= nvg__maxf(c->x, d->x) && nvg__minf(c->x, d->x) <= nvg__maxf(a->x, b->x) &&
+			nvg__minf(a->y, b->y) <= nvg__maxf(c->y, d->y) && nvg__minf(c->y, d->y) <= nvg__maxf(a->y, b->y);
+	return a0*a1 <= 0.0f && a2*a3 <= 0.0f;
+}
+
+static int nvg__isEar(const NVGvertex* pts, const int* idx, int n, int i)
+{
+	const NVGvertex* a = &pts[idx[(i+n-1) % n]];
+	const NVGvertex* b = &pts[idx[i]];
+	const NVGvertex* c = &pts[idx[(i+1) % n]];
+	int j;
+
+	// Reflex corners can't be clipped.
+	if (nvg__triarea2(a->x,a->y, b->x,b->y, c->x,c->y) <= 0.0f)
+		return 0;
+
+	// Nor can corners with any other vertex inside, or on the edge of, their triangle.
+	for (j = 2; j < n-1; j++) {
+		const NVGvertex* p = &pts[idx[(i+j) % n]];
+		if (nvg__triarea2(a->x,a->y, b->x,b->y, p->x,p->y) >= 0.0f &&
+			nvg__triarea2(b->x,b->y, c->x,c->y, p->x,p->y) >= 0.0f &&
+			nvg__triarea2(c->x,c->y, a->x,a->y, p->x,p->y) >= 0.0f)
+			return 0;
+	}
+	return 1;
+}
+
+// Ear clips the polygon into a triangle list written to dst, returning its vertex count.
+// Returns 0 when the polygon touches itself, as its fill then depends on the winding rule.
+static int nvg__triangulate(const NVGvertex* pts, int npts, NVGvertex* dst)
+{
+	int idx[NVG_MAX_TRIANGULATE_VERTS];
+	NVGvertex* out = dst;
+	float area = 0.0f;
+	int i, j, n, tries;
+
+	if (npts < 3 || npts > NVG_MAX_TRIANGULATE_VERTS)
+		return 0;
+
+	for (i = 0; i < npts; i++) {
+		for (j = i+2; j < npts; j++) {
+			if (i == 0 && j == npts-1)
+				continue;
+			if (nvg__segmentsTouch(&pts[i], &pts[i+1], &pts[j], &pts[(j+1) % npts]))
+				return 0;
+		}
+	}
+
+	// Solid paths wind the way back-ends take as front facing, the triangles keep that winding.
+	// Holes are left to the stencil, their fringe is on the other side.
+	for (i = 2; i < npts; i++)
+		area += nvg__triarea2(pts[0].x,pts[0].y, pts[i-1].x,pts[i-1].y, pts[i].x,pts[i].y);
+	if (area <= 0.0f)
+		return 0;
+
+	for (i = 0; i < npts; i++)
+		idx[i] = i;
+
+	n = npts;
+	i = 0;
+	tries = 0;
+	while (n > 3) {
+		if (nvg__isEar(pts, idx, n, i)) {
+			*out++ = pts[idx[(i+n-1) % n]];
+			*out++ = pts[idx[i]];
+			*out++ = pts[idx[(i+1) % n]];
+			for (j = i; j < n-1; j++)
+				idx[j] = idx[j+1];
+			n--;
+			i %= n;
+			tries = 0;
+		} else {
+			// Every simple polygon has an ear, only rounding errors get here.
+			i = (i+1) % n;
+			if (++tries > n)
+				return 0;
+		}
+	}
+	*out++ = pts[idx[0]];
+	*out++ = pts[idx[1]];
+	*out++ = pts[idx[2]];
+
+	return (int)(out - dst);
+}
+
 static int nvg__expandFill(NVGcontext* ctx, float w, int lineJoin, float miterLimit)
 {
 	NVGpathCache* cache = ctx->cache;
 	NVGvertex* verts;
 	NVGvertex* dst;
-	int cverts, convex, i, j;
+	int cverts, convex, triangulate, i, j;
 	float aa = ctx->fringeWidth;
 	int fringe = w > 0.0f;
 
@@ -1861,11 +2049,24 @@ static int nvg__expandFill(NVGcontext* ctx, float w, int lineJoin, float miterLi
 			cverts += (path->count + path->nbevel*5 + 1) * 2; // plus one for loop
 	}
 
+	convex = cache->npaths == 1 && cache->paths[0].convex;
+	triangulate = ctx->params.triangulateFills && cache->npaths == 1 && !convex;
+	if (triangulate) {
+		NVGpath* path = &cache->paths[0];
+		NVGpoint* pts = &cache->points[path->first];
+		// Without the stencil, a fringe folding over itself at a concave corner would be blended twice.
+		if (fringe) {
+			for (j = 0; j < path->count; j++) {
+				if (!(pts[j].flags & NVG_PT_LEFT) && (pts[j].flags & (NVG_PT_BEVEL | NVG_PR_INNERBEVEL)))
+					triangulate = 0;
+			}
+		}
+		cverts += (path->count + path->nbevel) * 3;
+	}
+
 	verts = nvg__allocTempVerts(ctx, cverts);
 	if (verts == NULL) return 0;
 
-	convex = cache->npaths == 1 && cache->paths[0].convex;
-
 	for (i = 0; i < cache->npaths; i++) {
 		NVGpath* path = &cache->paths[i];
 		NVGpoint* pts = &cache->points[path->first];
@@ -1916,6 +2117,18 @@ static int nvg__expandFill(NVGcontext* ctx, float w, int lineJoin, float miterLi
 		path->nfill = (int)(dst - verts);
 		verts = dst;
 
+		// A small concave fill is replaced by its triangles, which can be drawn like a convex one.
+		path->triangulated = 0;
+		if (triangulate && path->nfill <= NVG_MAX_TRIANGULATE_VERTS) {
+			int ntris = nvg__triangulate(path->fill, path->nfill, verts);
+			if (ntris > 0) {
+				path->fill = verts;
+				path->nfill = ntris;
+				path->triangulated = 1;
+				verts += ntris;
+			}
+		}
+
 		// Calculate fringe
 		if (fringe) {
 			lw = w + woff;
@@ -1927,7 +2140,7 @@ static int nvg__expandFill(NVGcontext* ctx, float w, int lineJoin, float miterLi
 
 			// Create only half a fringe for convex shapes so that
 			// the shape can be rendered without stenciling.
-			if (convex) {
+			if (convex || path->triangulated) {
 				lw = woff;	// This should generate the same vertex as fill inset above.
 				lu = 0.5f;	// Set outline fade at middle.
 			}
@@ -1963,9 +2176,22 @@ static int nvg__expandFill(NVGcontext* ctx, float w, int lineJoin, float miterLi
 
 
 // Draw
+static void nvg__setShape(NVGcontext* ctx, float cx, float cy, float hw, float hh, float r)
+{
+	NVGshape* shape = &ctx->shape;
+	shape->ncommands = ctx->ncommands;
+	memcpy(shape->xform, nvg__getState(ctx)->xform, sizeof(float)*6);
+	shape->cx = cx;
+	shape->cy = cy;
+	shape->hw = hw;
+	shape->hh = hh;
+	shape->r = r;
+}
+
 void nvgBeginPath(NVGcontext* ctx)
 {
 	ctx->ncommands = 0;
+	ctx->shape.ncommands = 0;
 	nvg__clearPathCache(ctx);
 }
 
@@ -2133,6 +2359,7 @@ void nvgArc(NVGcontext* ctx, float cx, float cy, float r, float a0, float a1, in
 
 void nvgRect(NVGcontext* ctx, float x, float y, float w, float h)
 {
+	int first = ctx->ncommands == 0;
 	float vals[] = {
 		NVG_MOVETO, x,y,
 		NVG_LINETO, x,y+h,
@@ -2141,6 +2368,8 @@ void nvgRect(NVGcontext* ctx, float x, float y, float w, float h)
 		NVG_CLOSE
 	};
 	nvg__appendCommands(ctx, vals, NVG_COUNTOF(vals));
+	if (first)
+		nvg__setShape(ctx, x + w*0.5f, y + h*0.5f, nvg__absf(w)*0.5f, nvg__absf(h)*0.5f, 0.0f);
 }
 
 void nvgRoundedRect(NVGcontext* ctx, float x, float y, float w, float h, float r)
@@ -2154,6 +2383,7 @@ void nvgRoundedRectVarying(NVGcontext* ctx, float x, float y, float w, float h,
 		nvgRect(ctx, x, y, w, h);
 		return;
 	} else {
+		int first = ctx->ncommands == 0;
 		float halfw = nvg__absf(w)*0.5f;
 		float halfh = nvg__absf(h)*0.5f;
 		float rxBL = nvg__minf(radBottomLeft, halfw) * nvg__signf(w), ryBL = nvg__minf(radBottomLeft, halfh) * nvg__signf(h);
@@ -2173,11 +2403,17 @@ void nvgRoundedRectVarying(NVGcontext* ctx, float x, float y, float w, float h,
 			NVG_CLOSE
 		};
 		nvg__appendCommands(ctx, vals, NVG_COUNTOF(vals));
+
+		// Corners clamped to different widths and heights are elliptical, they need the outline.
+		if (first && radTopLeft == radTopRight && radTopLeft == radBottomRight && radTopLeft == radBottomLeft &&
+			(radTopLeft <= nvg__minf(halfw, halfh) || halfw == halfh))
+			nvg__setShape(ctx, x + w*0.5f, y + h*0.5f, halfw, halfh, nvg__minf(radTopLeft, halfw));
 	}
 }
 
 void nvgEllipse(NVGcontext* ctx, float cx, float cy, float rx, float ry)
 {
+	int first = ctx->ncommands == 0;
 	float vals[] = {
 		NVG_MOVETO, cx-rx, cy,
 		NVG_BEZIERTO, cx-rx, cy+ry*NVG_KAPPA90, cx-rx*NVG_KAPPA90, cy+ry, cx, cy+ry,
@@ -2187,6 +2423,8 @@ void nvgEllipse(NVGcontext* ctx, float cx, float cy, float rx, float ry)
 		NVG_CLOSE
 	};
 	nvg__appendCommands(ctx, vals, NVG_COUNTOF(vals));
+	if (first && rx == ry)
+		nvg__setShape(ctx, cx, cy, nvg__absf(rx), nvg__absf(rx), nvg__absf(rx));
 }
 
 void nvgCircle(NVGcontext* ctx, float cx, float cy, float r)
@@ -2216,37 +2454,261 @@ void nvgDebugDumpPathCache(NVGcontext* ctx)
 	}
 }
 
-void nvgFill(NVGcontext* ctx)
+// Fills the path from the distance field of its shape, if it is one and the back-end can.
+static int nvg__fillShape(NVGcontext* ctx, NVGpaint* paint)
+{
+	NVGstate* state = nvg__getState(ctx);
+	NVGshape* shape = &ctx->shape;
+	const float* t = shape->xform;
+	float corners[4][2] = { {-1,-1}, {-1,1}, {1,1}, {1,-1} };
+	float scale, tol, margin, params[4];
+	NVGvertex quad[4];
+	int i;
+
+	if (ctx->params.renderShape == NULL || shape->ncommands == 0 || shape->ncommands != ctx->ncommands)
+		return 0;
+	if (shape->hw <= 0.0f || shape->hh <= 0.0f)
+		return 0;
+
+	// Image paints are drawn from the outline, and so are shapes with anti-aliasing turned off for them alone.
+	if (paint->image != 0 || (ctx->params.edgeAntiAlias && !state->shapeAntiAlias))
+		return 0;
+
+	// Distances only keep their proportions through rotations and uniform scales.
+	scale = nvg__sqrtf(t[0]*t[0] + t[1]*t[1]);
+	tol = 1e-3f * scale*scale;
+	if (scale < 1e-6f || nvg__absf(t[0]*t[2] + t[1]*t[3]) > tol || nvg__absf(t[2]*t[2] + t[3]*t[3] - scale*scale) > tol)
+		return 0;
+
+	// Wind the quad like nvgRect, also once mirrored.
+	if (t[0]*t[3] - t[1]*t[2] < 0.0f) {
+		corners[1][0] = 1; corners[1][1] = -1;
+		corners[3][0] = -1; corners[3][1] = 1;
+	}
+
+	// Reach a pixel past the edge for the anti-aliased falloff.
+	margin = ctx->fringeWidth / scale;
+	for (i = 0; i < 4; i++) {
+		float u = corners[i][0] * (shape->hw + margin);
+		float v = corners[i][1] * (shape->hh + margin);
+		float x, y;
+		nvgTransformPoint(&x, &y, t, shape->cx + u, shape->cy + v);
+		nvg__vset(&quad[i], x, y, u, v);
+	}
+
+	params[0] = shape->hw;
+	params[1] = shape->hh;
+	params[2] = shape->r;
+	params[3] = scale / ctx->fringeWidth;
+	ctx->params.renderShape(ctx->params.userPtr, paint, state->compositeOperation, &state->scissor, ctx->fringeWidth, quad, params);
+
+	ctx->fillTriCount += 2;
+	ctx->drawCallCount++;
+	return 1;
+}
+
+static void nvg__fillPaths(NVGcontext* ctx, NVGpaint* paint)
 {
 	NVGstate* state = nvg__getState(ctx);
 	const NVGpath* path;
-	NVGpaint fillPaint = state->fill;
 	int i;
 
+	if (nvg__fillShape(ctx, paint))
+		return;
+
 	nvg__flattenPaths(ctx);
 	if (ctx->params.edgeAntiAlias && state->shapeAntiAlias)
 		nvg__expandFill(ctx, ctx->fringeWidth, NVG_MITER, 2.4f);
 	else
 		nvg__expandFill(ctx, 0.0f, NVG_MITER, 2.4f);
 
-	// Apply global alpha
-	fillPaint.innerColor.a *= state->alpha;
-	fillPaint.outerColor.a *= state->alpha;
-
-	ctx->params.renderFill(ctx->params.userPtr, &fillPaint, state->compositeOperation, &state->scissor, ctx->fringeWidth,
+	ctx->params.renderFill(ctx->params.userPtr, paint, state->compositeOperation, &state->scissor, ctx->fringeWidth,
 						   ctx->cache->bounds, ctx->cache->paths, ctx->cache->npaths);
 
 	// Count triangles
 	for (i = 0; i < ctx->cache->npaths; i++) {
 		path = &ctx->cache->paths[i];
-		ctx->fillTriCount += path->nfill-2;
+		ctx->fillTriCount += path->triangulated ? path->nfill/3 : path->nfill-2;
 		ctx->fillTriCount += path->nstroke-2;
 		ctx->drawCallCount += 2;
 	}
 }
 
+void nvgFill(NVGcontext* ctx)
+{
+	NVG_TRACE_ZONE("nvgFill");
+	NVGstate* state = nvg__getState(ctx);
+	NVGpaint fillPaint = state->fill;
+
+	// Apply global alpha
+	fillPaint.innerColor.a *= state->alpha;
+	fillPaint.outerColor.a *= state->alpha;
+
+	nvg__fillPaths(ctx, &fillPaint);
+}
+
+static NVGinstance* nvg__allocInstances(NVGcontext* ctx, int ninstances)
+{
+	if (ninstances > ctx->cinstances) {
+		NVGinstance* instances;
+		int cinstances = (ninstances + 0xff) & ~0xff; // Round up to prevent allocations when things change just slightly.
+		instances = (NVGinstance*)realloc(ctx->instances, sizeof(NVGinstance)*cinstances);
+		if (instances == NULL) return NULL;
+		ctx->instances = instances;
+		ctx->cinstances = cinstances;
+	}
+
+	return ctx->instances;
+}
+
+static NVGvertex* nvg__allocInstanceVerts(NVGcontext* ctx, int nverts)
+{
+	if (nverts > ctx->cinstanceVerts) {
+		NVGvertex* verts;
+		int cverts = (nverts + 0xff) & ~0xff; // Round up to prevent allocations when things change just slightly.
+		verts = (NVGvertex*)realloc(ctx->instanceVerts, sizeof(NVGvertex)*cverts);
+		if (verts == NULL) return NULL;
+		ctx->instanceVerts = verts;
+		ctx->cinstanceVerts = cverts;
+	}
+
+	return ctx->instanceVerts;
+}
+
+static NVGcolor nvg__mulColor(NVGcolor a, NVGcolor b)
+{
+	return nvgRGBAf(a.r*b.r, a.g*b.g, a.b*b.b, a.a*b.a);
+}
+
+static void nvg__transformVerts(NVGvertex* dst, const NVGvertex* src, int nverts, const float* t)
+{
+	int i;
+	for (i = 0; i < nverts; i++) {
+		nvgTransformPoint(&dst[i].x, &dst[i].y, t, src[i].x, src[i].y);
+		dst[i].u = src[i].u;
+		dst[i].v = src[i].v;
+	}
+}
+
+// Back-ends without instancing get one fill per instance, the path being tessellated once and moved into place.
+static void nvg__fillEachInstance(NVGcontext* ctx, NVGpaint* paint, const NVGinstance* instances, int ninstances)
+{
+	NVGstate* state = nvg__getState(ctx);
+	NVGpathCache* cache = ctx->cache;
+	NVGvertex* saved;
+	NVGpath* path;
+	int i, j, nverts = 0;
+
+	nvg__flattenPaths(ctx);
+	if (ctx->params.edgeAntiAlias && state->shapeAntiAlias)
+		nvg__expandFill(ctx, ctx->fringeWidth, NVG_MITER, 2.4f);
+	else
+		nvg__expandFill(ctx, 0.0f, NVG_MITER, 2.4f);
+
+	for (i = 0; i < cache->npaths; i++)
+		nverts += cache->paths[i].nfill + cache->paths[i].nstroke;
+	saved = nvg__allocInstanceVerts(ctx, nverts);
+	if (saved == NULL) return;
+
+	nverts = 0;
+	for (i = 0; i < cache->npaths; i++) {
+		path = &cache->paths[i];
+		memcpy(&saved[nverts], path->fill, sizeof(NVGvertex)*path->nfill);
+		memcpy(&saved[nverts + path->nfill], path->stroke, sizeof(NVGvertex)*path->nstroke);
+		nverts += path->nfill + path->nstroke;
+	}
+
+	for (i = 0; i < ninstances; i++) {
+		const float* t = instances[i].xform;
+		NVGpaint instancePaint = *paint;
+		float corners[4][2] = {
+			{ cache->bounds[0], cache->bounds[1] }, { cache->bounds[2], cache->bounds[1] },
+			{ cache->bounds[2], cache->bounds[3] }, { cache->bounds[0], cache->bounds[3] },
+		};
+		float bounds[4] = { 1e6f, 1e6f, -1e6f, -1e6f };
+
+		nvgTransformMultiply(instancePaint.xform, t);
+		instancePaint.innerColor = nvg__mulColor(paint->innerColor, instances[i].color);
+		instancePaint.outerColor = nvg__mulColor(paint->outerColor, instances[i].color);
+
+		nverts = 0;
+		for (j = 0; j < cache->npaths; j++) {
+			path = &cache->paths[j];
+			nvg__transformVerts(path->fill, &saved[nverts], path->nfill, t);
+			nvg__transformVerts(path->stroke, &saved[nverts + path->nfill], path->nstroke, t);
+			nverts += path->nfill + path->nstroke;
+		}
+		for (j = 0; j < 4; j++) {
+			float x, y;
+			nvgTransformPoint(&x, &y, t, corners[j][0], corners[j][1]);
+			bounds[0] = nvg__minf(bounds[0], x);
+			bounds[1] = nvg__minf(bounds[1], y);
+			bounds[2] = nvg__maxf(bounds[2], x);
+			bounds[3] = nvg__maxf(bounds[3], y);
+		}
+
+		ctx->params.renderFill(ctx->params.userPtr, &instancePaint, state->compositeOperation, &state->scissor, ctx->fringeWidth,
+							   bounds, cache->paths, cache->npaths);
+	}
+
+	// Leave the cache as the path itself for a following nvgStroke().
+	nverts = 0;
+	for (i = 0; i < cache->npaths; i++) {
+		path = &cache->paths[i];
+		memcpy(path->fill, &saved[nverts], sizeof(NVGvertex)*path->nfill);
+		memcpy(path->stroke, &saved[nverts + path->nfill], sizeof(NVGvertex)*path->nstroke);
+		nverts += path->nfill + path->nstroke;
+
+		// Count triangles
+		ctx->fillTriCount += ((path->triangulated ? path->nfill/3 : path->nfill-2) + path->nstroke-2) * ninstances;
+		ctx->drawCallCount += 2 * ninstances;
+	}
+}
+
+void nvgFillInstances(NVGcontext* ctx, const float* xforms, const NVGcolor* colors, int count)
+{
+	NVG_TRACE_ZONE("nvgFillInstances");
+	NVGstate* state = nvg__getState(ctx);
+	NVGpaint fillPaint = state->fill;
+	NVGinstance* instances;
+	float inverse[6];
+	int i, fillTriCount;
+
+	if (count <= 0) return;
+	instances = nvg__allocInstances(ctx, count);
+	if (instances == NULL) return;
+
+	// Apply global alpha
+	fillPaint.innerColor.a *= state->alpha;
+	fillPaint.outerColor.a *= state->alpha;
+
+	// The path is already in view space, so each instance undoes the current transform before applying its own.
+	nvgTransformInverse(inverse, state->xform);
+	for (i = 0; i < count; i++) {
+		float* t = instances[i].xform;
+		memcpy(t, inverse, sizeof(float)*6);
+		nvgTransformMultiply(t, &xforms[i*6]);
+		nvgTransformMultiply(t, state->xform);
+		instances[i].color = colors != NULL ? colors[i] : nvgRGBAf(1.0f, 1.0f, 1.0f, 1.0f);
+	}
+
+	if (ctx->params.renderInstances == NULL) {
+		nvg__fillEachInstance(ctx, &fillPaint, instances, count);
+		return;
+	}
+
+	fillTriCount = ctx->fillTriCount;
+	ctx->params.renderInstances(ctx->params.userPtr, instances, count);
+	nvg__fillPaths(ctx, &fillPaint);
+	ctx->params.renderInstances(ctx->params.userPtr, NULL, 0);
+
+	// Count triangles
+	ctx->fillTriCount += (ctx->fillTriCount - fillTriCount) * (count-1);
+}
+
 void nvgStroke(NVGcontext* ctx)
 {
+	NVG_TRACE_ZONE("nvgStroke");
 	NVGstate* state = nvg__getState(ctx);
 	float scale = nvg__getAverageScale(state->xform);
 	float strokeWidth = nvg__clampf(state->strokeWidth * scale, 0.0f, 200.0f);
@@ -2451,6 +2913,7 @@ static void nvg__renderText(NVGcontext* ctx, NVGvertex* verts, int nverts)
 
 float nvgText(NVGcontext* ctx, float x, float y, const char* string, const char* end)
 {
+	NVG_TRACE_ZONE("nvgText");
 	NVGstate* state = nvg__getState(ctx);
 	FONStextIter iter, prevIter;
 	FONSquad q;
@@ -2508,8 +2971,9 @@ float nvgText(NVGcontext* ctx, float x, float y, const char* string, const char*
 		}
 	}
 
-	// TODO: add back-end bit to do this just once per frame.
-	nvg__flushTextTexture(ctx);
+	// Back-ends applying texture updates ahead of the frame's draws get the atlas once, in nvgEndFrame().
+	if (!ctx->params.deferredTextureUpdates)
+		nvg__flushTextTexture(ctx);
 
 	nvg__renderText(ctx, verts, nverts);
 
@@ -0,0 +1,636 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nanovg.h"
+#include "nanovg_capture.h"
+
+#define NVG_TRACE_MAGIC "NVGTRACE"
+#define NVG_TRACE_VERSION 5
+
+// Every record starts with one of these, followed by its payload.
+enum NVGtraceOp {
+	NVG_TRACE_VIEWPORT = 1,		// float width, height, devicePixelRatio
+	NVG_TRACE_CANCEL,
+	NVG_TRACE_FLUSH,
+	NVG_TRACE_CREATE_TEXTURE,	// int image, type, w, h, imageFlags, hasData, then w*h pixels if hasData
+	NVG_TRACE_DELETE_TEXTURE,	// int image
+	NVG_TRACE_UPDATE_TEXTURE,	// int image, x, y, w, h, then the w*h pixels of the rect
+	NVG_TRACE_FILL,				// state, float bounds[4], paths
+	NVG_TRACE_STROKE,			// state, float strokeWidth, paths
+	NVG_TRACE_TRIANGLES,		// state, int nverts, then the vertices
+	NVG_TRACE_SHAPE,			// state, the 4 vertices of the quad, float shape[4]
+	NVG_TRACE_INSTANCES,		// int ninstances, then the instances
+};
+
+// Images known to the trace, type is -1 for the ones created before the capture started.
+struct NVGtraceImage {
+	int id;
+	int type;
+	int width, height;
+	int replayId;			// Replay only, the image created in the replaying back-end.
+	unsigned char* data;	// Replay only, the whole image as the back-end expects it on updates.
+};
+typedef struct NVGtraceImage NVGtraceImage;
+
+struct NVGcapture {
+	NVGcontext* ctx;
+	NVGparams params;
+	FILE* fp;
+	int error;				// Set once a write failed, the rest of the trace is dropped.
+	NVGtraceImage* images;
+	int nimages;
+	int cimages;
+};
+
+static int nvg__traceBpp(int type)
+{
+	return type == NVG_TEXTURE_RGBA ? 4 : 1;
+}
+
+static NVGtraceImage* nvg__traceFindImage(NVGtraceImage* images, int nimages, int id)
+{
+	int i;
+	for (i = 0; i < nimages; i++) {
+		if (images[i].id == id)
+			return &images[i];
+	}
+	return NULL;
+}
+
+static NVGtraceImage* nvg__traceAddImage(NVGtraceImage** images, int* nimages, int* cimages, int id, int type, int w, int h)
+{
+	NVGtraceImage* image;
+	if (*nimages+1 > *cimages) {
+		int cnew = (*nimages+1) + *cimages/2; // 1.5x Overallocate
+		NVGtraceImage* inew = (NVGtraceImage*)realloc(*images, sizeof(NVGtraceImage)*cnew);
+		if (inew == NULL) return NULL;
+		*images = inew;
+		*cimages = cnew;
+	}
+	image = &(*images)[(*nimages)++];
+	memset(image, 0, sizeof(*image));
+	image->id = id;
+	image->type = type;
+	image->width = w;
+	image->height = h;
+	return image;
+}
+
+static void nvg__traceRemoveImage(NVGtraceImage* images, int* nimages, NVGtraceImage* image)
+{
+	*image = images[--(*nimages)];
+}
+
+//
+// Capture
+//
+
+static void nvg__capWrite(NVGcapture* cap, const void* data, size_t size)
+{
+	if (size > 0 && !cap->error && fwrite(data, 1, size, cap->fp) != size)
+		cap->error = 1;
+}
+
+static void nvg__capWriteInt(NVGcapture* cap, int value)
+{
+	nvg__capWrite(cap, &value, sizeof(value));
+}
+
+static void nvg__capWriteFloat(NVGcapture* cap, float value)
+{
+	nvg__capWrite(cap, &value, sizeof(value));
+}
+
+static void nvg__capWriteTexture(NVGcapture* cap, int image, int type, int w, int h, int imageFlags, const unsigned char* data)
+{
+	nvg__capWriteInt(cap, NVG_TRACE_CREATE_TEXTURE);
+	nvg__capWriteInt(cap, image);
+	nvg__capWriteInt(cap, type);
+	nvg__capWriteInt(cap, w);
+	nvg__capWriteInt(cap, h);
+	nvg__capWriteInt(cap, imageFlags);
+	nvg__capWriteInt(cap, data != NULL);
+	if (data != NULL)
+		nvg__capWrite(cap, data, (size_t)w * h * nvg__traceBpp(type));
+}
+
+// Images the trace hasn't seen being created are recorded as blank ones the first time they are used.
+static void nvg__capDeclareImage(NVGcapture* cap, int image)
+{
+	int w = 0, h = 0;
+	if (image == 0 || nvg__traceFindImage(cap->images, cap->nimages, image) != NULL)
+		return;
+	if (cap->params.renderGetTextureSize(cap->params.userPtr, image, &w, &h) == 0)
+		return;
+	if (nvg__traceAddImage(&cap->images, &cap->nimages, &cap->cimages, image, -1, w, h) == NULL)
+		return;
+	nvg__capWriteTexture(cap, image, NVG_TEXTURE_RGBA, w, h, 0, NULL);
+}
+
+static void nvg__capWriteState(NVGcapture* cap, int op, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor, float fringe)
+{
+	nvg__capDeclareImage(cap, paint->image);
+	nvg__capWriteInt(cap, op);
+	nvg__capWrite(cap, paint, sizeof(*paint));
+	nvg__capWrite(cap, &compositeOperation, sizeof(compositeOperation));
+	nvg__capWrite(cap, scissor, sizeof(*scissor));
+	nvg__capWriteFloat(cap, fringe);
+}
+
+static void nvg__capWritePaths(NVGcapture* cap, const NVGpath* paths, int npaths)
+{
+	int i;
+	nvg__capWriteInt(cap, npaths);
+	for (i = 0; i < npaths; i++) {
+		const NVGpath* path = &paths[i];
+		nvg__capWriteInt(cap, path->closed);
+		nvg__capWriteInt(cap, path->nbevel);
+		nvg__capWriteInt(cap, path->winding);
+		nvg__capWriteInt(cap, path->convex);
+		nvg__capWriteInt(cap, path->simpleStroke);
+		nvg__capWriteInt(cap, path->triangulated);
+		nvg__capWriteInt(cap, path->nfill);
+		nvg__capWriteInt(cap, path->nstroke);
+		nvg__capWrite(cap, path->fill, sizeof(NVGvertex) * path->nfill);
+		nvg__capWrite(cap, path->stroke, sizeof(NVGvertex) * path->nstroke);
+	}
+}
+
+static int nvg__capRenderCreate(void* uptr)
+{
+	NVGcapture* cap = (NVGcapture*)uptr;
+	return cap->params.renderCreate(cap->params.userPtr);
+}
+
+static int nvg__capRenderCreateTexture(void* uptr, int type, int w, int h, int imageFlags, const unsigned char* data)
+{
+	NVGcapture* cap = (NVGcapture*)uptr;
+	int image = cap->params.renderCreateTexture(cap->params.userPtr, type, w, h, imageFlags, data);
+	if (image != 0 && nvg__traceAddImage(&cap->images, &cap->nimages, &cap->cimages, image, type, w, h) != NULL)
+		nvg__capWriteTexture(cap, image, type, w, h, imageFlags, data);
+	return image;
+}
+
+static int nvg__capRenderDeleteTexture(void* uptr, int image)
+{
+	NVGcapture* cap = (NVGcapture*)uptr;
+	NVGtraceImage* traced = nvg__traceFindImage(cap->images, cap->nimages, image);
+	if (traced != NULL) {
+		nvg__capWriteInt(cap, NVG_TRACE_DELETE_TEXTURE);
+		nvg__capWriteInt(cap, image);
+		nvg__traceRemoveImage(cap->images, &cap->nimages, traced);
+	}
+	return cap->params.renderDeleteTexture(cap->params.userPtr, image);
+}
+
+static int nvg__capRenderUpdateTexture(void* uptr, int image, int x, int y, int w, int h, const unsigned char* data)
+{
+	NVGcapture* cap = (NVGcapture*)uptr;
+	NVGtraceImage* traced = nvg__traceFindImage(cap->images, cap->nimages, image);
+
+	// Only the updated rect is recorded, data holds the whole image. Without knowing the
+	// format of images created before the capture, their updates can't be recorded.
+	if (traced != NULL && traced->type != -1) {
+		int bpp = nvg__traceBpp(traced->type), row;
+		nvg__capWriteInt(cap, NVG_TRACE_UPDATE_TEXTURE);
+		nvg__capWriteInt(cap, image);
+		nvg__capWriteInt(cap, x);
+		nvg__capWriteInt(cap, y);
+		nvg__capWriteInt(cap, w);
+		nvg__capWriteInt(cap, h);
+		for (row = y; row < y + h; row++)
+			nvg__capWrite(cap, data + ((size_t)row * traced->width + x) * bpp, (size_t)w * bpp);
+	}
+	return cap->params.renderUpdateTexture(cap->params.userPtr, image, x, y, w, h, data);
+}
+
+static int nvg__capRenderGetTextureSize(void* uptr, int image, int* w, int* h)
+{
+	NVGcapture* cap = (NVGcapture*)uptr;
+	return cap->params.renderGetTextureSize(cap->params.userPtr, image, w, h);
+}
+
+static void nvg__capRenderViewport(void* uptr, float width, float height, float devicePixelRatio)
+{
+	NVGcapture* cap = (NVGcapture*)uptr;
+	nvg__capWriteInt(cap, NVG_TRACE_VIEWPORT);
+	nvg__capWriteFloat(cap, width);
+	nvg__capWriteFloat(cap, height);
+	nvg__capWriteFloat(cap, devicePixelRatio);
+	cap->params.renderViewport(cap->params.userPtr, width, height, devicePixelRatio);
+}
+
+static void nvg__capRenderCancel(void* uptr)
+{
+	NVGcapture* cap = (NVGcapture*)uptr;
+	nvg__capWriteInt(cap, NVG_TRACE_CANCEL);
+	cap->params.renderCancel(cap->params.userPtr);
+}
+
+static void nvg__capRenderFlush(void* uptr)
+{
+	NVGcapture* cap = (NVGcapture*)uptr;
+	nvg__capWriteInt(cap, NVG_TRACE_FLUSH);
+	cap->params.renderFlush(cap->params.userPtr);
+}
+
+static void nvg__capRenderFill(void* uptr, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor, float fringe,
+							   const float* bounds, const NVGpath* paths, int npaths)
+{
+	NVGcapture* cap = (NVGcapture*)uptr;
+	nvg__capWriteState(cap, NVG_TRACE_FILL, paint, compositeOperation, scissor, fringe);
+	nvg__capWrite(cap, bounds, sizeof(float) * 4);
+	nvg__capWritePaths(cap, paths, npaths);
+	cap->params.renderFill(cap->params.userPtr, paint, compositeOperation, scissor, fringe, bounds, paths, npaths);
+}
+
+static void nvg__capRenderStroke(void* uptr, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor, float fringe,
+								 float strokeWidth, const NVGpath* paths, int npaths)
+{
+	NVGcapture* cap = (NVGcapture*)uptr;
+	nvg__capWriteState(cap, NVG_TRACE_STROKE, paint, compositeOperation, scissor, fringe);
+	nvg__capWriteFloat(cap, strokeWidth);
+	nvg__capWritePaths(cap, paths, npaths);
+	cap->params.renderStroke(cap->params.userPtr, paint, compositeOperation, scissor, fringe, strokeWidth, paths, npaths);
+}
+
+static void nvg__capRenderTriangles(void* uptr, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor,
+									const NVGvertex* verts, int nverts, float fringe)
+{
+	NVGcapture* cap = (NVGcapture*)uptr;
+	nvg__capWriteState(cap, NVG_TRACE_TRIANGLES, paint, compositeOperation, scissor, fringe);
+	nvg__capWriteInt(cap, nverts);
+	nvg__capWrite(cap, verts, sizeof(NVGvertex) * nverts);
+	cap->params.renderTriangles(cap->params.userPtr, paint, compositeOperation, scissor, verts, nverts, fringe);
+}
+
+static void nvg__capRenderShape(void* uptr, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor, float fringe,
+								const NVGvertex* quad, const float* shape)
+{
+	NVGcapture* cap = (NVGcapture*)uptr;
+	nvg__capWriteState(cap, NVG_TRACE_SHAPE, paint, compositeOperation, scissor, fringe);
+	nvg__capWrite(cap, quad, sizeof(NVGvertex) * 4);
+	nvg__capWrite(cap, shape, sizeof(float) * 4);
+	cap->params.renderShape(cap->params.userPtr, paint, compositeOperation, scissor, fringe, quad, shape);
+}
+
+static void nvg__capRenderInstances(void* uptr, const NVGinstance* instances, int ninstances)
+{
+	NVGcapture* cap = (NVGcapture*)uptr;
+	nvg__capWriteInt(cap, NVG_TRACE_INSTANCES);
+	nvg__capWriteInt(cap, ninstances);
+	nvg__capWrite(cap, instances, sizeof(NVGinstance) * ninstances);
+	cap->params.renderInstances(cap->params.userPtr, instances, ninstances);
+}
+
+// Statistics are not part of the trace, they come straight from the wrapped back-end.
+static void nvg__capRenderGetStats(void* uptr, NVGframeStats* stats)
+{
+	NVGcapture* cap = (NVGcapture*)uptr;
+	cap->params.renderGetStats(cap->params.userPtr, stats);
+}
+
+NVGcapture* nvgCaptureBegin(NVGcontext* ctx, const char* path)
+{
+	NVGparams* params = nvgInternalParams(ctx);
+	const unsigned char* atlas;
+	int atlasImage = 0, atlasWidth = 0, atlasHeight = 0;
+	NVGcapture* cap = (NVGcapture*)malloc(sizeof(NVGcapture));
+	if (cap == NULL) return NULL;
+	memset(cap, 0, sizeof(NVGcapture));
+
+	cap->fp = fopen(path, "wb");
+	if (cap->fp == NULL) {
+		free(cap);
+		return NULL;
+	}
+	cap->ctx = ctx;
+	cap->params = *params;
+
+	nvg__capWrite(cap, NVG_TRACE_MAGIC, 8);
+	nvg__capWriteInt(cap, NVG_TRACE_VERSION);
+
+	// The font atlas is created along with the context, start the trace with its current contents.
+	atlas = nvgInternalFontAtlas(ctx, &atlasImage, &atlasWidth, &atlasHeight);
+	if (atlasImage != 0 && nvg__traceAddImage(&cap->images, &cap->nimages, &cap->cimages, atlasImage, NVG_TEXTURE_ALPHA, atlasWidth, atlasHeight) != NULL)
+		nvg__capWriteTexture(cap, atlasImage, NVG_TEXTURE_ALPHA, atlasWidth, atlasHeight, 0, atlas);
+
+	params->userPtr = cap;
+	params->renderCreate = nvg__capRenderCreate;
+	params->renderCreateTexture = nvg__capRenderCreateTexture;
+	params->renderDeleteTexture = nvg__capRenderDeleteTexture;
+	params->renderUpdateTexture = nvg__capRenderUpdateTexture;
+	params->renderGetTextureSize = nvg__capRenderGetTextureSize;
+	params->renderViewport = nvg__capRenderViewport;
+	params->renderCancel = nvg__capRenderCancel;
+	params->renderFlush = nvg__capRenderFlush;
+	params->renderFill = nvg__capRenderFill;
+	params->renderStroke = nvg__capRenderStroke;
+	params->renderTriangles = nvg__capRenderTriangles;
+	if (cap->params.renderShape != NULL)
+		params->renderShape = nvg__capRenderShape;
+	if (cap->params.renderInstances != NULL)
+		params->renderInstances = nvg__capRenderInstances;
+	if (cap->params.renderGetStats != NULL)
+		params->renderGetStats = nvg__capRenderGetStats;
+
+	return cap;
+}
+
+int nvgCaptureEnd(NVGcapture* cap)
+{
+	int ok;
+	if (cap == NULL) return 0;
+	*nvgInternalParams(cap->ctx) = cap->params;
+	ok = fclose(cap->fp) == 0 && !cap->error;
+	free(cap->images);
+	free(cap);
+	return ok;
+}
+
+//
+// Replay
+//
+
+struct NVGreplay {
+	FILE* fp;
+	NVGparams* params;
+	NVGtraceImage* images;
+	int nimages;
+	int cimages;
+	NVGpath* paths;
+	int cpaths;
+	NVGvertex* verts;
+	int cverts;
+	NVGinstance* instances;
+	int cinstances;
+};
+typedef struct NVGreplay NVGreplay;
+
+static int nvg__repRead(NVGreplay* rep, void* data, size_t size)
+{
+	return size == 0 || fread(data, 1, size, rep->fp) == size;
+}
+
+static int nvg__repReadInt(NVGreplay* rep, int* value)
+{
+	return nvg__repRead(rep, value, sizeof(*value));
+}
+
+static int nvg__repReadFloat(NVGreplay* rep, float* value)
+{
+	return nvg__repRead(rep, value, sizeof(*value));
+}
+
+static int nvg__repReadState(NVGreplay* rep, NVGpaint* paint, NVGcompositeOperationState* compositeOperation, NVGscissor* scissor, float* fringe)
+{
+	NVGtraceImage* image;
+	if (!nvg__repRead(rep, paint, sizeof(*paint)) || !nvg__repRead(rep, compositeOperation, sizeof(*compositeOperation)) ||
+		!nvg__repRead(rep, scissor, sizeof(*scissor)) || !nvg__repReadFloat(rep, fringe))
+		return 0;
+
+	// Point the paint at the image created for this replay.
+	if (paint->image != 0) {
+		image = nvg__traceFindImage(rep->images, rep->nimages, paint->image);
+		paint->image = image != NULL ? image->replayId : 0;
+	}
+	return 1;
+}
+
+static int nvg__repReserveVerts(NVGreplay* rep, int n)
+{
+	if (n > rep->cverts) {
+		int cverts = n + rep->cverts/2; // 1.5x Overallocate
+		NVGvertex* verts = (NVGvertex*)realloc(rep->verts, sizeof(NVGvertex) * cverts);
+		if (verts == NULL) return 0;
+		rep->verts = verts;
+		rep->cverts = cverts;
+	}
+	return 1;
+}
+
+static int nvg__repReadInstances(NVGreplay* rep, int* ninstances)
+{
+	if (!nvg__repReadInt(rep, ninstances) || *ninstances < 0)
+		return 0;
+
+	if (*ninstances > rep->cinstances) {
+		NVGinstance* instances = (NVGinstance*)realloc(rep->instances, sizeof(NVGinstance) * *ninstances);
+		if (instances == NULL) return 0;
+		rep->instances = instances;
+		rep->cinstances = *ninstances;
+	}
+	return nvg__repRead(rep, rep->instances, sizeof(NVGinstance) * *ninstances);
+}
+
+static int nvg__repReadPaths(NVGreplay* rep, int* npaths)
+{
+	int i, nverts = 0, offset = 0;
+	if (!nvg__repReadInt(rep, npaths) || *npaths < 0)
+		return 0;
+
+	if (*npaths > rep->cpaths) {
+		NVGpath* paths = (NVGpath*)realloc(rep->paths, sizeof(NVGpath) * *npaths);
+		if (paths == NULL) return 0;
+		rep->paths = paths;
+		rep->cpaths = *npaths;
+	}
+
+	for (i = 0; i < *npaths; i++) {
+		NVGpath* path = &rep->paths[i];
+		int header[8];
+		if (!nvg__repRead(rep, header, sizeof(header)) || header[6] < 0 || header[7] < 0)
+			return 0;
+		memset(path, 0, sizeof(*path));
+		path->closed = (unsigned char)header[0];
+		path->nbevel = header[1];
+		path->winding = header[2];
+		path->convex = header[3];
+		path->simpleStroke = header[4];
+		path->triangulated = header[5];
+		path->nfill = header[6];
+		path->nstroke = header[7];
+		if (!nvg__repReserveVerts(rep, nverts + path->nfill + path->nstroke) ||
+			!nvg__repRead(rep, &rep->verts[nverts], sizeof(NVGvertex) * (path->nfill + path->nstroke)))
+			return 0;
+		nverts += path->nfill + path->nstroke;
+	}
+
+	// The vertex storage may have moved while reading, only point the paths at it now.
+	for (i = 0; i < *npaths; i++) {
+		NVGpath* path = &rep->paths[i];
+		path->fill = &rep->verts[offset];
+		path->stroke = &rep->verts[offset + path->nfill];
+		offset += path->nfill + path->nstroke;
+	}
+	return 1;
+}
+
+static int nvg__repCreateTexture(NVGreplay* rep)
+{
+	int header[6];
+	NVGtraceImage* image;
+	size_t size;
+	if (!nvg__repRead(rep, header, sizeof(header)) || header[2] <= 0 || header[3] <= 0)
+		return 0;
+
+	image = nvg__traceAddImage(&rep->images, &rep->nimages, &rep->cimages, header[0], header[1], header[2], header[3]);
+	if (image == NULL) return 0;
+
+	// Images declared without data start out blank.
+	size = (size_t)image->width * image->height * nvg__traceBpp(image->type);
+	image->data = (unsigned char*)calloc(size, 1);
+	if (image->data == NULL || (header[5] && !nvg__repRead(rep, image->data, size)))
+		return 0;
+
+	image->replayId = rep->params->renderCreateTexture(rep->params->userPtr, image->type, image->width, image->height, header[4], image->data);
+	return 1;
+}
+
+static int nvg__repUpdateTexture(NVGreplay* rep)
+{
+	int header[5], bpp, row;
+	NVGtraceImage* image;
+	if (!nvg__repRead(rep, header, sizeof(header)))
+		return 0;
+
+	image = nvg__traceFindImage(rep->images, rep->nimages, header[0]);
+	if (image == NULL || header[1] < 0 || header[2] < 0 || header[1] + header[3] > image->width || header[2] + header[4] > image->height)
+		return 0;
+
+	// Patch the rect into the whole image, which is what back-ends are handed.
+	bpp = nvg__traceBpp(image->type);
+	for (row = header[2]; row < header[2] + header[4]; row++) {
+		if (!nvg__repRead(rep, image->data + ((size_t)row * image->width + header[1]) * bpp, (size_t)header[3] * bpp))
+			return 0;
+	}
+
+	rep->params->renderUpdateTexture(rep->params->userPtr, image->replayId, header[1], header[2], header[3], header[4], image->data);
+	return 1;
+}
+
+static int nvg__repDeleteTexture(NVGreplay* rep)
+{
+	int id;
+	NVGtraceImage* image;
+	if (!nvg__repReadInt(rep, &id))
+		return 0;
+
+	image = nvg__traceFindImage(rep->images, rep->nimages, id);
+	if (image == NULL) return 0;
+
+	rep->params->renderDeleteTexture(rep->params->userPtr, image->replayId);
+	free(image->data);
+	nvg__traceRemoveImage(rep->images, &rep->nimages, image);
+	return 1;
+}
+
+static int nvg__repRun(NVGreplay* rep)
+{
+	NVGparams* params = rep->params;
+	NVGpaint paint;
+	NVGcompositeOperationState compositeOperation;
+	NVGscissor scissor;
+	float fringe, values[4];
+	int op, count, frames = 0;
+	char magic[8];
+
+	if (!nvg__repRead(rep, magic, sizeof(magic)) || memcmp(magic, NVG_TRACE_MAGIC, sizeof(magic)) != 0 ||
+		!nvg__repReadInt(rep, &op) || op != NVG_TRACE_VERSION)
+		return -1;
+
+	while (nvg__repReadInt(rep, &op)) {
+		switch (op) {
+		case NVG_TRACE_VIEWPORT:
+			if (!nvg__repRead(rep, values, sizeof(float) * 3)) return -1;
+			params->renderViewport(params->userPtr, values[0], values[1], values[2]);
+			break;
+		case NVG_TRACE_CANCEL:
+			params->renderCancel(params->userPtr);
+			break;
+		case NVG_TRACE_FLUSH:
+			params->renderFlush(params->userPtr);
+			frames++;
+			break;
+		case NVG_TRACE_CREATE_TEXTURE:
+			if (!nvg__repCreateTexture(rep)) return -1;
+			break;
+		case NVG_TRACE_DELETE_TEXTURE:
+			if (!nvg__repDeleteTexture(rep)) return -1;
+			break;
+		case NVG_TRACE_UPDATE_TEXTURE:
+			if (!nvg__repUpdateTexture(rep)) return -1;
+			break;
+		case NVG_TRACE_FILL:
+			if (!nvg__repReadState(rep, &paint, &compositeOperation, &scissor, &fringe) ||
+				!nvg__repRead(rep, values, sizeof(float) * 4) || !nvg__repReadPaths(rep, &count))
+				return -1;
+			params->renderFill(params->userPtr, &paint, compositeOperation, &scissor, fringe, values, rep->paths, count);
+			break;
+		case NVG_TRACE_STROKE:
+			if (!nvg__repReadState(rep, &paint, &compositeOperation, &scissor, &fringe) ||
+				!nvg__repReadFloat(rep, &values[0]) || !nvg__repReadPaths(rep, &count))
+				return -1;
+			params->renderStroke(params->userPtr, &paint, compositeOperation, &scissor, fringe, values[0], rep->paths, count);
+			break;
+		case NVG_TRACE_TRIANGLES:
+			if (!nvg__repReadState(rep, &paint, &compositeOperation, &scissor, &fringe) ||
+				!nvg__repReadInt(rep, &count) || count < 0 || !nvg__repReserveVerts(rep, count) ||
+				!nvg__repRead(rep, rep->verts, sizeof(NVGvertex) * count))
+				return -1;
+			params->renderTriangles(params->userPtr, &paint, compositeOperation, &scissor, rep->verts, count, fringe);
+			break;
+		case NVG_TRACE_SHAPE:
+			if (!nvg__repReadState(rep, &paint, &compositeOperation, &scissor, &fringe) ||
+				!nvg__repReserveVerts(rep, 4) || !nvg__repRead(rep, rep->verts, sizeof(NVGvertex) * 4) ||
+				!nvg__repRead(rep, values, sizeof(float) * 4))
+				return -1;
+			// Only back-ends which offer it record these.
+			if (params->renderShape != NULL)
+				params->renderShape(params->userPtr, &paint, compositeOperation, &scissor, fringe, rep->verts, values);
+			break;
+		case NVG_TRACE_INSTANCES:
+			if (!nvg__repReadInstances(rep, &count))
+				return -1;
+			// Only back-ends which offer it record these.
+			if (params->renderInstances != NULL)
+				params->renderInstances(params->userPtr, rep->instances, count);
+			break;
+		default:
+			return -1;
+		}
+	}
+
+	return frames;
+}
+
+int nvgReplayTrace(NVGcontext* ctx, const char* path)
+{
+	NVGreplay rep;
+	int i, frames;
+
+	memset(&rep, 0, sizeof(rep));
+	rep.params = nvgInternalParams(ctx);
+	rep.fp = fopen(path, "rb");
+	if (rep.fp == NULL) return -1;
+
+	frames = nvg__repRun(&rep);
+
+	// Calls of an unfinished frame must not leak into the next one.
+	if (frames < 0)
+		rep.params->renderCancel(rep.params->userPtr);
+
+	for (i = 0; i < rep.nimages; i++) {
+		if (rep.images[i].replayId != 0)
+			rep.params->renderDeleteTexture(rep.params->userPtr, rep.images[i].replayId);
+		free(rep.images[i].data);
+	}
+
+	fclose(rep.fp);
+	free(rep.images);
+	free(rep.paths);
+	free(rep.verts);
+	free(rep.instances);
+	return frames;
+}
@@ -0,0 +1,165 @@
+#include "nanovg_trace.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef NVG_TRACE
+
+#include <atomic>
+#include <new>
+
+#ifdef __SWITCH__
+#include <switch.h>
+#else
+#include <chrono>
+#endif
+
+namespace {
+
+    struct Event {
+        const char *name;
+        uint64_t start;
+        uint64_t end;
+    };
+
+    /* Written by its thread only. Readers look at the events below count, which is published last. */
+    struct Ring {
+        Event events[NVG_TRACE_RING_SIZE];
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> first;
+        int thread_id;
+        Ring *next;
+    };
+
+    /* Rings are never freed, so zones of threads which have exited can still be dumped. */
+    std::atomic<Ring *> g_rings{nullptr};
+    std::atomic<int> g_thread_count{0};
+    thread_local Ring *t_ring = nullptr;
+
+    uint64_t GetTimestamp() {
+        #ifdef __SWITCH__
+        return armGetSystemTick();
+        #else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        #endif
+    }
+
+    double TimestampToMicroseconds(uint64_t timestamp) {
+        #ifdef __SWITCH__
+        return armTicksToNs(timestamp) / 1000.0;
+        #else
+        return timestamp / 1000.0;
+        #endif
+    }
+
+    Ring *GetRing() {
+        if (t_ring != nullptr) {
+            return t_ring;
+        }
+
+        Ring *ring = new (std::nothrow) Ring;
+        if (ring == nullptr) {
+            return nullptr;
+        }
+
+        ring->count.store(0, std::memory_order_relaxed);
+        ring->first.store(0, std::memory_order_relaxed);
+        ring->thread_id = g_thread_count.fetch_add(1, std::memory_order_relaxed) + 1;
+
+        /* Push it onto the list of rings, other threads may be doing the same. */
+        ring->next = g_rings.load(std::memory_order_relaxed);
+        while (!g_rings.compare_exchange_weak(ring->next, ring, std::memory_order_release, std::memory_order_relaxed)) {
+            /* ring->next was reloaded, try again. */
+        }
+
+        t_ring = ring;
+        return ring;
+    }
+
+    void WriteEscaped(FILE *file, const char *string) {
+        for (; *string != '\0'; string++) {
+            if (*string == '"' || *string == '\\') {
+                fputc('\\', file);
+            }
+            fputc(*string, file);
+        }
+    }
+
+}
+
+extern "C" NVGtraceZone nvgTraceZoneBegin(const char *name) {
+    return NVGtraceZone{name, GetTimestamp()};
+}
+
+extern "C" void nvgTraceZoneEnd(NVGtraceZone *zone) {
+    const uint64_t end = GetTimestamp();
+
+    Ring *ring = GetRing();
+    if (ring == nullptr) {
+        return;
+    }
+
+    const uint64_t count = ring->count.load(std::memory_order_relaxed);
+    ring->events[count % NVG_TRACE_RING_SIZE] = Event{zone->name, zone->start, end};
+    ring->count.store(count + 1, std::memory_order_release);
+}
+
+extern "C" int nvgTraceDump(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == nullptr) {
+        return -1;
+    }
+
+    int written = 0;
+    fputs("{\"traceEvents\":[", file);
+
+    for (Ring *ring = g_rings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next) {
+        /* Only the last NVG_TRACE_RING_SIZE zones are still around. */
+        const uint64_t count = ring->count.load(std::memory_order_acquire);
+        uint64_t first = ring->first.load(std::memory_order_relaxed);
+        if (count - first > NVG_TRACE_RING_SIZE) {
+            first = count - NVG_TRACE_RING_SIZE;
+        }
+
+        for (uint64_t i = first; i < count; i++) {
+            const Event &event = ring->events[i % NVG_TRACE_RING_SIZE];
+            fputs(written > 0 ? ",\n{\"name\":\"" : "\n{\"name\":\"", file);
+            WriteEscaped(file, event.name);
+            fprintf(file, "\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+                TimestampToMicroseconds(event.start), TimestampToMicroseconds(event.end - event.start), ring->thread_id);
+            written++;
+        }
+    }
+
+    fputs("\n],\"displayTimeUnit\":\"ms\"}\n", file);
+    if (fclose(file) != 0) {
+        return -1;
+    }
+    return written;
+}
+
+extern "C" void nvgTraceClear(void) {
+    for (Ring *ring = g_rings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next) {
+        ring->first.store(ring->count.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
+
+#else
+
+extern "C" NVGtraceZone nvgTraceZoneBegin(const char *name) {
+    return NVGtraceZone{name, 0};
+}
+
+extern "C" void nvgTraceZoneEnd(NVGtraceZone *zone) {
+    /* ... */
+}
+
+extern "C" int nvgTraceDump(const char *path) {
+    return -1;
+}
+
+extern "C" void nvgTraceClear(void) {
+    /* ... */
+}
+
+#endif
@@ -0,0 +1,138 @@
+#include "null_renderer.hpp"
+
+#include <string.h>
+
+namespace nvg {
+
+    NullRenderer::Texture *NullRenderer::FindTexture(int id) {
+        if (id <= 0 || id > static_cast<int>(m_textures.size())) {
+            return nullptr;
+        }
+
+        return m_textures[id - 1].get();
+    }
+
+    int NullRenderer::Create(DKNVGcontext &ctx) {
+        /* Uniforms are packed the same way as for DkRenderer, so that frames are laid out as on the GPU. */
+        ctx.fragSize = FragmentUniformSize;
+        return 1;
+    }
+
+    int NullRenderer::CreateTexture(const DKNVGcontext &ctx, int type, int w, int h, int image_flags, const uint8_t *data) {
+        int slot;
+
+        /* Reuse a free slot if possible. */
+        if (!m_free_textures.empty()) {
+            slot = m_free_textures.back();
+            m_free_textures.pop_back();
+        } else {
+            slot = m_textures.size();
+            m_textures.emplace_back();
+        }
+
+        const size_t bpp = type == NVG_TEXTURE_RGBA ? 4 : 1;
+        auto texture = std::make_unique<Texture>();
+        texture->descriptor = {
+            .width = w,
+            .height = h,
+            .type = type,
+            .flags = image_flags,
+        };
+        texture->data.resize(w * h * bpp);
+
+        if (data != nullptr) {
+            memcpy(texture->data.data(), data, texture->data.size());
+        }
+
+        m_textures[slot] = std::move(texture);
+        return slot + 1;
+    }
+
+    int NullRenderer::DeleteTexture(const DKNVGcontext &ctx, int id) {
+        if (this->FindTexture(id) == nullptr) {
+            return 0;
+        }
+
+        m_textures[id - 1].reset();
+        m_free_textures.push_back(id - 1);
+        return 1;
+    }
+
+    int NullRenderer::UpdateTexture(const DKNVGcontext &ctx, int id, int x, int y, int w, int h, const uint8_t *data) {
+        Texture *texture = this->FindTexture(id);
+
+        /* Could not find a texture. */
+        if (texture == nullptr) {
+            return 0;
+        }
+
+        /* Only the dirty rect is copied, data holds the whole image. */
+        const size_t bpp = texture->descriptor.type == NVG_TEXTURE_RGBA ? 4 : 1;
+        const size_t pitch = texture->descriptor.width * bpp;
+        for (int row = y; row < y + h; row++) {
+            memcpy(texture->data.data() + row * pitch + x * bpp, data + row * pitch + x * bpp, w * bpp);
+        }
+        return 1;
+    }
+
+    int NullRenderer::GetTextureSize(const DKNVGcontext &ctx, int id, int *w, int *h) {
+        const auto descriptor = this->GetTextureDescriptor(ctx, id);
+        if (descriptor == nullptr) {
+            return 0;
+        }
+
+        *w = descriptor->width;
+        *h = descriptor->height;
+        return 1;
+    }
+
+    const DKNVGtextureDescriptor *NullRenderer::GetTextureDescriptor(const DKNVGcontext &ctx, int id) {
+        Texture *texture = this->FindTexture(id);
+        return texture != nullptr ? &texture->descriptor : nullptr;
+    }
+
+    void NullRenderer::Flush(DKNVGcontext &ctx) {
+        /* Go through the same batching as a GPU renderer, writing the results to host memory instead. */
+        const int index_count = MergeCalls(ctx);
+
+        m_calls.assign(ctx.calls, ctx.calls + ctx.ncalls);
+        m_vertices.assign(ctx.verts, ctx.verts + ctx.nverts);
+        m_uniforms.assign(ctx.uniforms, ctx.uniforms + ctx.nuniforms * ctx.fragSize);
+        m_instances.assign(ctx.instances, ctx.instances + ctx.ninstances);
+        m_indices.resize(index_count);
+        WriteIndices(ctx, m_indices.data());
+
+        /* Reset calls. */
+        ctx.nverts = 0;
+        ctx.npaths = 0;
+        ctx.ncalls = 0;
+        ctx.nuniforms = 0;
+        ctx.ninstances = 0;
+    }
+
+    const std::vector<DKNVGcall> &NullRenderer::GetCalls() const {
+        return m_calls;
+    }
+
+    const std::vector<NVGvertex> &NullRenderer::GetVertices() const {
+        return m_vertices;
+    }
+
+    const std::vector<uint32_t> &NullRenderer::GetIndices() const {
+        return m_indices;
+    }
+
+    const std::vector<uint8_t> &NullRenderer::GetUniforms() const {
+        return m_uniforms;
+    }
+
+    const std::vector<DKNVGinstance> &NullRenderer::GetInstances() const {
+        return m_instances;
+    }
+
+    const std::vector<uint8_t> *NullRenderer::GetTextureData(int id) {
+        Texture *texture = this->FindTexture(id);
+        return texture != nullptr ? &texture->data : nullptr;
+    }
+
+}
@@ -0,0 +1,164 @@
+#include "renderer.hpp"
+
+#include <string.h>
+
+namespace nvg {
+
+    namespace {
+
+        constexpr int TriangleListCount(int vertex_count) {
+            return vertex_count > 2 ? (vertex_count - 2) * 3 : 0;
+        }
+
+        template<typename T>
+        T *WriteFanIndices(T *out, int offset, int count) {
+            for (int i = 1; i < count - 1; i++) {
+                *out++ = offset;
+                *out++ = offset + i;
+                *out++ = offset + i + 1;
+            }
+            return out;
+        }
+
+        int FillIndexCount(const DKNVGpath &path) {
+            return path.triangulated ? path.fillCount : TriangleListCount(path.fillCount);
+        }
+
+        template<typename T>
+        T *WriteFillIndices(T *out, const DKNVGpath &path) {
+            /* Triangulated fills are triangle lists already, the others are fans. */
+            if (path.triangulated) {
+                for (int i = 0; i < path.fillCount; i++) {
+                    *out++ = path.fillOffset + i;
+                }
+                return out;
+            }
+            return WriteFanIndices(out, path.fillOffset, path.fillCount);
+        }
+
+        template<typename T>
+        T *WriteStripIndices(T *out, int offset, int count) {
+            /* Every other triangle of a strip has its first two vertices swapped to keep the winding consistent. */
+            for (int i = 0; i < count - 2; i++) {
+                *out++ = offset + i + (i & 1);
+                *out++ = offset + i + 1 - (i & 1);
+                *out++ = offset + i + 2;
+            }
+            return out;
+        }
+
+        template<typename T>
+        void WriteCallIndices(const DKNVGcontext &ctx, T *indices) {
+            for (int i = 0; i < ctx.ncalls; i++) {
+                const DKNVGcall &call = ctx.calls[i];
+                const DKNVGpath *paths = &ctx.paths[call.pathOffset];
+                T *out = indices + call.indexOffset;
+
+                if (call.type == DKNVG_CONVEXFILL) {
+                    /* Keep each path's fringe right after its fill, as they would have been drawn separately. */
+                    for (int j = 0; j < call.pathCount; j++) {
+                        out = WriteFillIndices(out, paths[j]);
+                        out = WriteStripIndices(out, paths[j].strokeOffset, paths[j].strokeCount);
+                    }
+                } else if (call.type == DKNVG_FILL) {
+                    /* The stencil pass covers all fills, followed by a separate range for the fringes. */
+                    for (int j = 0; j < call.pathCount; j++) {
+                        out = WriteFillIndices(out, paths[j]);
+                    }
+                    for (int j = 0; j < call.pathCount; j++) {
+                        out = WriteStripIndices(out, paths[j].strokeOffset, paths[j].strokeCount);
+                    }
+                } else if (call.type == DKNVG_STROKE) {
+                    for (int j = 0; j < call.pathCount; j++) {
+                        out = WriteStripIndices(out, paths[j].strokeOffset, paths[j].strokeCount);
+                    }
+                }
+            }
+        }
+
+        bool CanMergeCalls(const DKNVGcontext &ctx, const DKNVGcall &prev, const DKNVGcall &call) {
+            if (prev.type != call.type || prev.image != call.image || memcmp(&prev.blendFunc, &call.blendFunc, sizeof(DKNVGblend)) != 0) {
+                return false;
+            }
+
+            /* Instanced calls draw their own set of instances, a single one at that. */
+            if (prev.instanceCount != 0 || call.instanceCount != 0) {
+                return false;
+            }
+
+            /* Both calls have to draw from ranges which follow each other. */
+            if (call.type == DKNVG_TRIANGLES) {
+                if (prev.triangleOffset + prev.triangleCount != call.triangleOffset) {
+                    return false;
+                }
+            } else if (call.type == DKNVG_CONVEXFILL || (call.type == DKNVG_STROKE && !(ctx.flags & NVG_STENCIL_STROKES))) {
+                /* Stencil strokes must stay separate, overlaps between two strokes are still blended twice. */
+                if (prev.pathOffset + prev.pathCount != call.pathOffset) {
+                    return false;
+                }
+            } else {
+                return false;
+            }
+
+            /* Merged calls share a single set of uniforms, so the paint, scissor etc. must be identical. */
+            return prev.uniformOffset == call.uniformOffset || memcmp(ctx.uniforms + prev.uniformOffset, ctx.uniforms + call.uniformOffset, sizeof(DKNVGfragUniforms)) == 0;
+        }
+
+    }
+
+    int Renderer::MergeCalls(DKNVGcontext &ctx) {
+        int ncalls = 0;
+        int nindices = 0;
+
+        for (int i = 0; i < ctx.ncalls; i++) {
+            const DKNVGcall &call = ctx.calls[i];
+
+            /* Fold the call into the previous one where possible, otherwise keep it as is. */
+            if (ncalls > 0 && CanMergeCalls(ctx, ctx.calls[ncalls - 1], call)) {
+                DKNVGcall &prev = ctx.calls[ncalls - 1];
+                prev.pathCount += call.pathCount;
+                prev.triangleCount += call.triangleCount;
+            } else {
+                ctx.calls[ncalls++] = call;
+            }
+        }
+        ctx.ncalls = ncalls;
+
+        /* Lay out the index ranges of every call, paths are drawn as triangle lists so that a call takes a single draw. */
+        for (int i = 0; i < ctx.ncalls; i++) {
+            DKNVGcall &call = ctx.calls[i];
+            const DKNVGpath *paths = &ctx.paths[call.pathOffset];
+            int fill_count = 0;
+            int stroke_count = 0;
+
+            for (int j = 0; j < call.pathCount; j++) {
+                fill_count += FillIndexCount(paths[j]);
+                stroke_count += TriangleListCount(paths[j].strokeCount);
+            }
+
+            call.indexOffset = nindices;
+            if (call.type == DKNVG_CONVEXFILL) {
+                call.indexCount = fill_count + stroke_count;
+            } else if (call.type == DKNVG_FILL) {
+                call.indexCount = fill_count;
+                call.fringeIndexOffset = nindices + fill_count;
+                call.fringeIndexCount = stroke_count;
+                nindices += stroke_count;
+            } else if (call.type == DKNVG_STROKE) {
+                call.indexCount = stroke_count;
+            }
+            nindices += call.indexCount;
+        }
+
+        return nindices;
+    }
+
+    void Renderer::WriteIndices(const DKNVGcontext &ctx, uint16_t *indices) {
+        WriteCallIndices(ctx, indices);
+    }
+
+    void Renderer::WriteIndices(const DKNVGcontext &ctx, uint32_t *indices) {
+        WriteCallIndices(ctx, indices);
+    }
+
+}
@@ -0,0 +1,170 @@
+/*
+** Packs compiled deko3d shaders (.dksh) into a single archive, laid out as described in
+** DkshArchive.h so that CShaderArchive can load all of them with one read of their code.
+**
+**   dkshpack <out.dkshpak> <in.dksh>...
+**
+** Shaders are named after their file, without directory or extension.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/nanovg/framework/DkshArchive.h"
+
+typedef struct Shader
+{
+	const char* path;
+	DkshHeader hdr;
+	void* control;
+	void* code;
+} Shader;
+
+static uint32_t alignUp(uint32_t value, uint32_t alignment)
+{
+	return (value + alignment - 1) &~ (alignment - 1);
+}
+
+static int readShader(Shader* shader, const char* path)
+{
+	FILE* f = fopen(path, "rb");
+	if (!f) {
+		fprintf(stderr, "dkshpack: cannot open %s\n", path);
+		return 0;
+	}
+
+	shader->path = path;
+	if (!fread(&shader->hdr, sizeof(shader->hdr), 1, f) || shader->hdr.magic != DKSH_MAGIC ||
+		shader->hdr.control_sz < sizeof(shader->hdr) || shader->hdr.num_programs != 1) {
+		fprintf(stderr, "dkshpack: %s is not a single program dksh file\n", path);
+		goto _fail;
+	}
+
+	// The control section starts with the header itself, the code follows it
+	shader->control = malloc(shader->hdr.control_sz);
+	shader->code = malloc(shader->hdr.code_sz ? shader->hdr.code_sz : 1);
+	if (!shader->control || !shader->code)
+		goto _fail;
+
+	rewind(f);
+	if (!fread(shader->control, shader->hdr.control_sz, 1, f) ||
+		(shader->hdr.code_sz && !fread(shader->code, shader->hdr.code_sz, 1, f))) {
+		fprintf(stderr, "dkshpack: %s is truncated\n", path);
+		goto _fail;
+	}
+
+	fclose(f);
+	return 1;
+
+_fail:
+	fclose(f);
+	return 0;
+}
+
+static void shaderName(char* name, const char* path)
+{
+	const char* base = strrchr(path, '/');
+	const char* ext;
+	size_t len;
+
+	base = base ? base+1 : path;
+	ext = strrchr(base, '.');
+	len = ext ? (size_t)(ext - base) : strlen(base);
+	if (len > DKSH_ARCHIVE_NAME_LEN-1)
+		len = DKSH_ARCHIVE_NAME_LEN-1;
+
+	memset(name, 0, DKSH_ARCHIVE_NAME_LEN);
+	memcpy(name, base, len);
+}
+
+static int writePadding(FILE* f, uint32_t size)
+{
+	static const char zeros[DKSH_ARCHIVE_CODE_ALIGNMENT];
+	return size == 0 || fwrite(zeros, size, 1, f) == 1;
+}
+
+int main(int argc, char* argv[])
+{
+	DkshArchiveHeader hdr;
+	DkshArchiveEntry* entries;
+	Shader* shaders;
+	uint32_t i, num, offset;
+	FILE* f;
+
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s <out.dkshpak> <in.dksh>...\n", argv[0]);
+		return 1;
+	}
+
+	num = (uint32_t)(argc - 2);
+	shaders = (Shader*)calloc(num, sizeof(Shader));
+	entries = (DkshArchiveEntry*)calloc(num, sizeof(DkshArchiveEntry));
+	if (!shaders || !entries)
+		return 1;
+
+	for (i = 0; i < num; i++)
+		if (!readShader(&shaders[i], argv[i+2]))
+			return 1;
+
+	// Index and control sections first
+	offset = sizeof(hdr) + num*sizeof(DkshArchiveEntry);
+	for (i = 0; i < num; i++) {
+		shaderName(entries[i].name, shaders[i].path);
+		entries[i].control_off = offset;
+		entries[i].control_sz = shaders[i].hdr.control_sz;
+		offset += alignUp(shaders[i].hdr.control_sz, 4);
+	}
+
+	hdr.magic = DKSH_ARCHIVE_MAGIC;
+	hdr.num_shaders = num;
+	hdr.code_off = alignUp(offset, DKSH_ARCHIVE_CODE_ALIGNMENT);
+
+	// Then the code of every shader, each one aligned the way deko3d wants it
+	offset = 0;
+	for (i = 0; i < num; i++) {
+		entries[i].code_off = offset;
+		entries[i].code_sz = shaders[i].hdr.code_sz;
+		offset = alignUp(offset + shaders[i].hdr.code_sz, DKSH_ARCHIVE_CODE_ALIGNMENT);
+	}
+	hdr.code_sz = offset;
+
+	f = fopen(argv[1], "wb");
+	if (!f) {
+		fprintf(stderr, "dkshpack: cannot create %s\n", argv[1]);
+		return 1;
+	}
+
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 || fwrite(entries, sizeof(DkshArchiveEntry), num, f) != num)
+		goto _fail;
+
+	offset = sizeof(hdr) + num*sizeof(DkshArchiveEntry);
+	for (i = 0; i < num; i++) {
+		uint32_t size = alignUp(shaders[i].hdr.control_sz, 4);
+		if (fwrite(shaders[i].control, shaders[i].hdr.control_sz, 1, f) != 1 ||
+			!writePadding(f, size - shaders[i].hdr.control_sz))
+			goto _fail;
+		offset += size;
+	}
+	if (!writePadding(f, hdr.code_off - offset))
+		goto _fail;
+
+	for (i = 0; i < num; i++) {
+		uint32_t size = alignUp(shaders[i].hdr.code_sz, DKSH_ARCHIVE_CODE_ALIGNMENT);
+		if ((shaders[i].hdr.code_sz && fwrite(shaders[i].code, shaders[i].hdr.code_sz, 1, f) != 1) ||
+			!writePadding(f, size - shaders[i].hdr.code_sz))
+			goto _fail;
+	}
+
+	if (fclose(f) != 0) {
+		remove(argv[1]);
+		fprintf(stderr, "dkshpack: cannot write %s\n", argv[1]);
+		return 1;
+	}
+	return 0;
+
+_fail:
+	fclose(f);
+	remove(argv[1]);
+	fprintf(stderr, "dkshpack: cannot write %s\n", argv[1]);
+	return 1;
+}